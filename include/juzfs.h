@@ -37,33 +37,185 @@ int   			   	juzfs_rmdir(const char *);
 int   			   	juzfs_rename(const char *, const char *);
 int   			   	juzfs_utimens(const char *, const struct timespec tv[2]);
 int   			   	juzfs_truncate(const char *, off_t);
+int   			   	juzfs_fallocate(const char *, int, off_t, off_t, struct fuse_file_info *);
 			
 int   			   	juzfs_open(const char *, struct fuse_file_info *);
+int   			   	juzfs_release(const char *, struct fuse_file_info *);
+int   			   	juzfs_statfs(const char *, struct statvfs *);
 int   			   	juzfs_opendir(const char *, struct fuse_file_info *);
+int   			   	juzfs_flush(const char *, struct fuse_file_info *);
+int   			   	juzfs_fsync(const char *, int, struct fuse_file_info *);
+int   			   	juzfs_fsyncdir(const char *, int, struct fuse_file_info *);
 
 /******************************************************************************
 * SECTION: juzfs_util.c
 *******************************************************************************/
 int 			   	jfs_mount(struct custom_options);
-int                	jfs_driver_read(int, uint8_t *, int);
-int 				jfs_driver_write(int, uint8_t *, int);
+int                	jfs_dev_read(uint64_t, uint8_t *, int);
+int                	jfs_dev_write(uint64_t, uint8_t *, int);
+int 				jfs_dev_submit(struct juzfs_io *, int);
+int 				jfs_dev_submit_sync(struct juzfs_io *, int);
+int 				jfs_dev_wait(void);
+uint8_t*			jfs_dev_ptr(uint64_t);
+int 				jfs_dev_sync(void);
+int                	jfs_driver_read(uint64_t, uint8_t *, int);
+int 				jfs_driver_write(uint64_t, uint8_t *, int);
+int 				jfs_driver_readv(struct juzfs_iovec *, int);
+int 				jfs_driver_writev(struct juzfs_iovec *, int);
+int 				jfs_file_iovec(struct juzfs_inode *, uint8_t *, off_t, size_t, struct juzfs_iovec *, bool);
+int64_t 			jfs_file_fill_holes(struct juzfs_inode *, uint64_t, uint64_t, bool);
+int 				jfs_file_pwrite(struct juzfs_inode *, const uint8_t *, off_t, size_t);
+struct juzfs_file*	jfs_file_alloc(void);
+void 				jfs_file_free(struct juzfs_file *);
+void 				jfs_file_readahead(struct juzfs_file *, struct juzfs_inode *, off_t, size_t);
 struct juzfs_inode* jfs_alloc_inode(struct juzfs_dentry *);
+void 				jfs_inode_mark_dirty(struct juzfs_inode *);
+void 				jfs_dir_mark_dirty(struct juzfs_inode *, int);
 int 				jfs_sync_inode(struct juzfs_inode *);
+int 				jfs_flush(void);
+int 				jfs_writeback(uint64_t);
+int 				jfs_fsync_inode(struct juzfs_inode *);
 struct juzfs_inode* jfs_read_inode(struct juzfs_dentry *, int);
 int 				jfs_alloc_dentry(struct juzfs_inode*, struct juzfs_dentry*, bool);
-uint64_t  			jfs_alloc_data_blk();
+int 				jfs_read_dentrys(struct juzfs_inode*, int);
+struct juzfs_dentry*jfs_find_dentry(struct juzfs_inode*, const char*);
+int  				jfs_alloc_data_blk(void);
 struct juzfs_dentry*jfs_lookup(const char *, bool*, bool*);
 int 				jfs_calc_lvl(const char *);
 char* 				jfs_get_name(const char*);
-struct juzfs_dentry*jfs_get_dentry(struct juzfs_inode *, int);
+struct juzfs_dentry*jfs_get_dentry(struct juzfs_inode *, uint64_t);
 int 				jfs_umount(void);
+int 				jfs_alloc_data_blks(int, int, int*);
 int  				jfs_dealloc_data_blk(int);
+void 				jfs_dealloc_data_blks(uint64_t, uint32_t);
+int 				jfs_inline_resize(struct juzfs_inode *, uint64_t);
+int 				jfs_inline_promote(struct juzfs_inode *);
 int 				juzfs_drop_dentry(struct juzfs_inode *, struct juzfs_dentry *);
 int 				juzfs_drop_inode(struct juzfs_inode *);
 
+/******************************************************************************
+* SECTION: juzfs_backend.c
+*******************************************************************************/
+const struct juzfs_backend* jfs_backend_select(const char*);
+int 				jfs_file_open(const char*);
+int 				jfs_file_read(int, uint64_t, uint8_t*, int);
+int 				jfs_file_write(int, uint64_t, uint8_t*, int);
+int 				jfs_file_disk_size(int, uint64_t*);
+int 				jfs_file_io_size(int, int*);
+int 				jfs_file_state(int, struct ddriver_state*);
+void 				jfs_file_count(struct juzfs_io*);
+int 				jfs_file_sync(int);
+
+/******************************************************************************
+* SECTION: juzfs_uring.c
+*******************************************************************************/
+extern const struct juzfs_backend jfs_uring_backend;
+
+/******************************************************************************
+* SECTION: juzfs_cache.c
+*******************************************************************************/
+int 				jfs_cache_init(int);
+bool 				jfs_cache_enabled(void);
+struct juzfs_buf*	jfs_cache_get(uint64_t);
+struct juzfs_buf*	jfs_cache_get_for_write(uint64_t, int, int);
+int 				jfs_cache_prefetch(uint64_t, int);
+int 				jfs_cache_readahead(const uint64_t*, int);
+void 				jfs_cache_mark_dirty(struct juzfs_buf*);
+int 				jfs_cache_flush(void);
+int 				jfs_cache_flush_expired(uint64_t, uint64_t);
+int 				jfs_cache_flush_ranges(const struct juzfs_range*, int);
+void 				jfs_cache_set_dirty_ratio(int);
+bool 				jfs_cache_over_dirty_limit(void);
+void 				jfs_cache_destroy(void);
+struct juzfs_cache_stats* jfs_cache_stats(void);
+
+/******************************************************************************
+* SECTION: juzfs_writeback.c
+*******************************************************************************/
+uint64_t 			jfs_now_ms(void);
+void 				jfs_lock(void);
+void 				jfs_unlock(void);
+void 				jfs_wb_kick(void);
+int 				jfs_wb_start(struct custom_options);
+void 				jfs_wb_stop(void);
+
+/******************************************************************************
+* SECTION: juzfs_dcache.c
+*******************************************************************************/
+int 				jfs_dcache_init(int);
+struct juzfs_dentry*jfs_dcache_lookup(const char*, bool*);
+void 				jfs_dcache_insert(const char*, struct juzfs_dentry*, bool);
+void 				jfs_dcache_forget_path(const char*);
+void 				jfs_dcache_forget_dentry(struct juzfs_dentry*);
+void 				jfs_dcache_forget_subtree(const char*);
+void 				jfs_dcache_destroy(void);
+struct juzfs_dcache_stats* jfs_dcache_stats(void);
+
+/******************************************************************************
+* SECTION: juzfs_extent.c
+*******************************************************************************/
+void 				jfs_extent_init(struct juzfs_inode*);
+int 				jfs_extent_map(struct juzfs_inode*, uint32_t, uint64_t*);
+int 				jfs_extent_insert(struct juzfs_inode*, uint32_t, uint64_t, uint32_t);
+int 				jfs_extent_convert(struct juzfs_inode*, uint32_t, uint32_t);
+int 				jfs_extent_truncate(struct juzfs_inode*, uint32_t);
+int 				jfs_extent_walk(struct juzfs_inode*, void (*)(void*, uint64_t, uint32_t), void*);
+
+/******************************************************************************
+* SECTION: juzfs_dtree.c
+*******************************************************************************/
+uint64_t 			jfs_dtree_key(const char*);
+int 				jfs_dtree_lookup(struct juzfs_inode*, const char*, struct juzfs_dtree_ent*);
+int 				jfs_dtree_insert(struct juzfs_inode*, const char*, uint32_t, JFS_FILE_TYPE);
+int 				jfs_dtree_delete(struct juzfs_inode*, const char*);
+int 				jfs_dtree_update(struct juzfs_inode*, const char*, uint32_t);
+int 				jfs_dtree_scan(struct juzfs_inode*, uint64_t, struct juzfs_dtree_ent*, int);
+int 				jfs_dtree_build(struct juzfs_inode*);
+void 				jfs_dtree_destroy(struct juzfs_inode*);
+
+/******************************************************************************
+* SECTION: juzfs_bitmap.c
+*******************************************************************************/
+int 				jfs_bitmap_find_zero(const uint8_t*, int, int);
+int 				jfs_bitmap_init(struct juzfs_bitmap*, uint8_t*, int, int, int);
+void 				jfs_bitmap_destroy(struct juzfs_bitmap*);
+int 				jfs_bitmap_next_dirty(const struct juzfs_bitmap*, int, int*);
+void 				jfs_bitmap_clean(struct juzfs_bitmap*);
+int 				jfs_bitmap_alloc(struct juzfs_bitmap*);
+void 				jfs_bitmap_free(struct juzfs_bitmap*, int);
+int 				jfs_bitmap_alloc_run(struct juzfs_bitmap*, int, int, int*);
+int 				jfs_bitmap_count(const uint8_t*, int);
+void 				jfs_bitmap_set(uint8_t*, int);
+void 				jfs_bitmap_clear(uint8_t*, int);
+bool 				jfs_bitmap_test(const uint8_t*, int);
+
+/******************************************************************************
+* SECTION: juzfs_dir.c
+*******************************************************************************/
+uint32_t 			jfs_name_hash(const char*);
+struct juzfs_dentry*jfs_dir_find(struct juzfs_inode*, const char*);
+int 				jfs_dir_add(struct juzfs_inode*, struct juzfs_dentry*);
+void 				jfs_dir_remove(struct juzfs_inode*, struct juzfs_dentry*);
+int 				jfs_dir_seek(struct juzfs_inode*, uint64_t);
+void 				jfs_dir_free(struct juzfs_inode*);
+
+/******************************************************************************
+* SECTION: juzfs_arena.c
+*******************************************************************************/
+void* 				jfs_malloc(size_t);
+void* 				jfs_calloc(size_t, size_t);
+uint64_t 			jfs_heap_allocs(void);
+void* 				jfs_scratch_alloc(size_t);
+struct juzfs_arena_mark jfs_scratch_mark(void);
+void 				jfs_scratch_release(struct juzfs_arena_mark);
+
 /******************************************************************************
 * SECTION: juzfs_debug.c
 *******************************************************************************/
 void jfs_dump_map(void);
+void jfs_dump_cache(void);
+void jfs_dump_dcache(void);
+void jfs_dump_dev_state(const char*);
+void jfs_dump_frag(void);
 
 #endif  /* _juzfs_H_ */
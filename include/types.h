@@ -16,6 +16,14 @@ typedef enum jfs_file_type {
 
 struct custom_options {
 	const char*        device;
+	const char*        backend;         /* 存储后端：ddriver / file / uring / mmap */
+	int                queue_depth;     /* 异步后端的队列深度 */
+	int                cache_size;      /* 块缓存预算，单位KiB，0表示关闭缓存 */
+	int                inode_size;      /* 格式化时每个inode槽的字节数 */
+	int                dcache_size;     /* 路径缓存项数，0表示关闭 */
+	int                writeback_ms;    /* 后台回写的检查周期，0表示关闭后台回写 */
+	int                dirty_expire_ms; /* 改动超过此时长由后台写回 */
+	int                dirty_ratio;     /* 块缓存中脏块超过此百分比时立即唤醒后台回写 */
 };
 
 /******************************************************************************
@@ -26,13 +34,57 @@ struct custom_options {
 #define UINT8_BITS              8
 
 #define JFS_MAGIC           0x114514
+#define JFS_SUPER_CLEAN     0x1    /* 正常卸载，空闲计数可信 */
 #define JFS_DEFAULT_PERM    0777   /* 全权限打开 */
 #define JFS_SUPER_OFS           (uint64_t)0
 
 #define JFS_ROOT_INO            0
 
-#define JFS_INODE_PER_FILE      1
-#define JFS_DATA_PER_FILE       6
+#define JFS_INODE_PER_FILE      1      /* 布局估算用：每个文件的inode块数 */
+
+#define JFS_LAYOUT_LEGACY       0      /* 每块一个inode，旧镜像此处为0 */
+#define JFS_LAYOUT_PACKED       1      /* 每块若干个定长inode槽 */
+#define JFS_DEFAULT_INODE_SZ    512    /* 与ddriver的IO单位相同，内联写无需先读 */
+#define JFS_MIN_INODE_SZ        128
+#define JFS_DATA_PER_FILE       6      /* 布局估算用：平均每个文件的数据块数；区段树之前的inode固定存放这么多块号 */
+
+#define JFS_INODE_INLINE        0x1    /* 文件内容直接存放在inode槽中 */
+#define JFS_INODE_DIRENT_VAR    0x2    /* 目录块为变长目录项，size为目录项总字节数；旧目录为定长项 */
+
+#define JFS_EXT_MAGIC           0xE7F5
+#define JFS_EXT_ROOT_CNT        4      /* inode内嵌的区段树根节点项数 */
+#define JFS_EXT_MAX_DEPTH       5      /* 4 * 63^5 个区段，远超设备容量 */
+#define JFS_EXT_MAX_BLKS        UINT32_MAX /* 文件块号为32位 */
+#define JFS_EXT_HOLE            UINT64_MAX /* jfs_extent_map 落在空洞中时的数据块号 */
+#define JFS_EXT_UNWRITTEN       (1ULL << 63) /* pblk 最高位：预分配未写，读为零 */
+
+#define JFS_INODE_DTREE         0x4    /* 目录为按名字哈希的B+树，根节点是目录的第0块 */
+#define JFS_DTREE_MAGIC         0xD7EE
+#define JFS_DTREE_MAX_DEPTH     5      /* 63^5 个叶子，远超inode数 */
+#define JFS_DIR_FLAT_MAX_BLKS   4      /* 平铺目录超过该块数时转为B+树 */
+#define JFS_DTREE_SCAN_BATCH    32     /* readdir 每次从B+树取出的项数 */
+#define JFS_DIR_CLEAN           INT32_MAX  /* dir_dirty：目录块与磁盘一致 */
+
+#define JFS_DEFAULT_CACHE_SZ    256    /* 默认块缓存大小 KiB */
+#define JFS_DEFAULT_DCACHE_SZ   1024   /* 默认路径缓存项数 */
+#define JFS_DCACHE_PATH_LEN     256    /* 更长的路径不进入路径缓存 */
+
+#define JFS_DEFAULT_WRITEBACK_MS    5000   /* 后台回写周期 */
+#define JFS_DEFAULT_DIRTY_EXPIRE_MS 30000  /* 崩溃时最多丢失约此时长加一个周期的改动 */
+#define JFS_DEFAULT_DIRTY_RATIO     10     /* 脏块占块缓存的百分比 */
+
+#define JFS_BUF_DIRTY           0x1
+#define JFS_BUF_READAHEAD       0x2    /* 由预读装入，尚未被访问 */
+
+#define JFS_RA_MIN_BLKS         2      /* 顺序读的初始预读窗口 (块) */
+#define JFS_RA_MAX_BLKS         32     /* 预读窗口上限 (块) */
+
+#define JFS_HEAD_UNKNOWN        UINT64_MAX
+#define JFS_FILE_IO_SZ          512    /* 文件镜像后端的IO单位 */
+#define JFS_DEFAULT_QUEUE_DEPTH 32
+
+#define JFS_ARENA_CHUNK_SZ      (64 * 1024)  /* 线程临时区每次增长的大小 */
+#define JFS_ARENA_ALIGN         16
 
 // #define JFS_DENTRYS_SEG_SIZE    7
 
@@ -49,47 +101,121 @@ struct custom_options {
 #define JFS_BLK_SZ()                    (JFS_IO_SZ() * 2)
 #define JFS_DISK_SZ()                   (super.sz_disk)
 #define JFS_DRIVER()                    (super.fd)
+#define JFS_BACKEND()                   (super.backend)
+#define JFS_DEV_MAPPED()                (super.base != NULL)
 #define JFS_DENTRYS_SEG_SIZE()          (JFS_BLK_SZ() / sizeof(struct juzfs_dentry_d))
 
-#define JFS_INODE_DATA_OFS_ARRAY_SIZE() (sizeof(uint64_t)*JFS_DATA_PER_FILE)
+#define JFS_EXT_FIRST(eh)               ((struct juzfs_extent *)((eh) + 1))
+#define JFS_EXT_IDX(eh)                 ((struct juzfs_extent_idx *)((eh) + 1))
+#define JFS_EXT_PBLK(pblk)              ((pblk) & ~JFS_EXT_UNWRITTEN)
+#define JFS_EXT_IS_UNWRITTEN(pblk)      ((pblk) != JFS_EXT_HOLE && ((pblk) & JFS_EXT_UNWRITTEN))
+#define JFS_EXT_NODE_MAX()              ((JFS_BLK_SZ() - sizeof(struct juzfs_extent_header)) / sizeof(struct juzfs_extent))
+#define JFS_DTREE_IDX(dh)               ((struct juzfs_dtree_idx *)((dh) + 1))
+#define JFS_DTREE_RECS(dh)              ((uint8_t *)((dh) + 1))
+#define JFS_DTREE_IDX_MAX()             ((JFS_BLK_SZ() - sizeof(struct juzfs_dtree_header)) / sizeof(struct juzfs_dtree_idx))
+#define JFS_DTREE_LEAF_CAP()            (JFS_BLK_SZ() - sizeof(struct juzfs_dtree_header))
+#define JFS_DTREE_REC_LEN(name_len)     JFS_ROUND_UP(sizeof(struct juzfs_dtree_rec) + (name_len), 8)
 
 #define JFS_ROUND_DOWN(value, round)    ((value) % (round) == 0 ? (value) : ((value) / (round)) * (round))
 #define JFS_ROUND_UP(value, round)      ((value) % (round) == 0 ? (value) : ((value) / (round) + 1) * (round))
 
 #define JFS_BLKS_SZ(blks)               ((blks) * JFS_BLK_SZ())
 
-#define JFS_MAP_INO_OFS()                (super.map_inode_offset * JFS_BLK_SZ())
-#define JFS_INO_OFS(ino)                ((super.ino_list_offset + (ino)) * JFS_BLK_SZ())
+#define JFS_MAP_INO_OFS()                (super.map_inode_offset)
+#define JFS_INODE_SZ()                  (super.sz_inode)        /* 每个inode槽的大小 */
+#define JFS_INLINE_MAX()                (JFS_INODE_SZ() - sizeof(struct juzfs_inode_d))
+#define JFS_INO_OFS(ino)                (super.ino_list_offset + (uint64_t)(ino) * JFS_INODE_SZ())
 #define JFS_DATA_OFS(blkno)               (super.data_offset + JFS_BLKS_SZ(blkno))
 
 #define JFS_IS_DIR(pinode)              (pinode->dentry->ftype == DIR_TYPE)
 #define JFS_IS_FILE(pinode)              (pinode->dentry->ftype == FILE_TYPE)
+#define JFS_DIR_COMPLETE(pinode)        ((pinode)->dir_loaded - (pinode)->dir_holes == (pinode)->dir_cnt)
+#define JFS_IS_INLINE(pinode)           ((pinode)->flags & JFS_INODE_INLINE)
+#define JFS_IS_DIRENT_VAR(pinode)       ((pinode)->flags & JFS_INODE_DIRENT_VAR)
+#define JFS_IS_DTREE(pinode)            ((pinode)->flags & JFS_INODE_DTREE)
+#define JFS_DIRENT_LEN(name_len)        JFS_ROUND_UP(sizeof(struct juzfs_dirent_d) + (name_len), 4)
+#define JFS_DIRENT_MAX_LEN              JFS_DIRENT_LEN(MAX_NAME_LEN - 1)
 #define JFS_ASSIGN_NAME(dentry, _name) memcpy(dentry->name, _name, strlen(_name))
 
 /******************************************************************************
 * SECTION: Structure - In memory
 *******************************************************************************/
 
+struct ddriver_state;
+
+/**
+ * 批量异步IO的一项，offset和size须与IO单位对齐，buf在wait返回前须保持有效
+ */
+struct juzfs_io {
+    uint64_t            offset;
+    uint8_t*            buf;
+    int                 size;
+    bool                is_write;
+    int                 result;         /* 完成后的传输字节数或负错误码 */
+};
+
+/**
+ * 存储后端：read/write 为按偏移的定位传输，offset和size须与IO单位对齐；
+ * submit/wait 可选，为NULL时批量IO同步执行
+ */
+struct juzfs_backend {
+    const char*         name;
+    int                 (*open)(const char*);
+    int                 (*close)(int);
+    int                 (*read)(int, uint64_t, uint8_t*, int);
+    int                 (*write)(int, uint64_t, uint8_t*, int);
+    int                 (*disk_size)(int, uint64_t*);
+    int                 (*io_size)(int, int*);
+    int                 (*state)(int, struct ddriver_state*);   /* 设备读写/寻道计数 */
+    int                 (*submit)(int, struct juzfs_io*, int);  /* 提交一批IO，不等待 */
+    int                 (*wait)(int);                           /* 等待已提交的全部IO */
+    uint8_t*            (*map)(int, uint64_t);                  /* 映射整个设备，返回基址 */
+    int                 (*sync)(int);                           /* 已写入的数据落盘 (映射区 msync，文件 fdatasync) */
+};
+
 /**
 * 注意：offset均用块表示
 */
+/**
+ * 分配位图：磁盘位图 + 内存中的两级摘要，摘要第 w 位表示位图第 w 个64位字仍有空闲位
+ */
+struct juzfs_bitmap {
+    uint8_t*            map;        /* 磁盘位图 */
+    int                 nbits;
+    uint64_t*           summary;
+    int                 nwords;     /* 位图的64位字数 */
+    int                 nfree;      /* 空闲位数 */
+    int                 cursor;     /* next-fit 起点 */
+    uint64_t*           dirty;      /* 每位对应位图的一段，置位表示该段改过、尚未写回 */
+    int                 chunk_bits; /* 每段的位数 */
+    int                 nchunks;
+};
+
 struct juzfs_super {
     uint32_t            magic;
     int                 fd;  //only in mem
+    const struct juzfs_backend* backend; //only in mem
     
     int                 sz_io;  // io大小 only in mem
-    int                 sz_disk; //only in mem
-    int                 sz_usage;
+    uint64_t            sz_disk; //only in mem
+    uint64_t            head;    // 设备磁头位置，JFS_HEAD_UNKNOWN表示未知 only in mem
+    int                 queue_depth; // 异步后端队列深度 only in mem
+    uint8_t*            base;    // 设备映射基址，NULL表示未映射 only in mem
+    uint64_t            sz_usage; // 挂载时由空闲计数导出
     
+    uint32_t            layout_version;
     int                 max_ino;
+    int                 sz_inode; // inode槽大小，旧布局为一个块
     uint64_t            map_inode_blks;
     uint64_t            map_inode_offset;
     uint8_t*            map_inode; //only in mem
+    struct juzfs_bitmap ino_bm;  // inode位图的摘要与空闲计数 only in mem
 
     int                 max_data_blks;
     uint64_t            map_data_blks;
     uint64_t            map_data_offset;
     uint8_t*            map_data; //only in mem
+    struct juzfs_bitmap data_bm; // 数据位图的摘要与空闲计数 only in mem
 
     uint64_t            ino_list_blks;
     uint64_t            ino_list_offset;
@@ -100,21 +226,95 @@ struct juzfs_super {
     bool                is_mounted; //only in mem
 
     struct juzfs_dentry* root_dentry; //only in mem
+    struct juzfs_inode* dirty_inodes; // 有改动未写回的inode，按变脏先后排列 only in mem
+    struct juzfs_inode** dirty_tail;  // 链表尾的 dirty_next only in mem
+};
+
+/**
+ * 区段树 (同时是磁盘格式)：节点为一个头部加若干16字节的项，depth为0的叶子节点
+ * 存放区段，其余节点存放索引项；根节点嵌在inode中，其余节点各占一个数据块
+ */
+struct juzfs_extent_header {
+    uint16_t                magic;                         /* JFS_EXT_MAGIC */
+    uint16_t                entries;
+    uint16_t                max;
+    uint16_t                depth;                         /* 到叶子的层数，0表示叶子 */
+};
+
+struct juzfs_extent {                                      /* 文件块 [lblk, lblk + len) -> 数据块 [pblk, pblk + len) */
+    uint32_t                lblk;
+    uint32_t                len;
+    uint64_t                pblk;                           /* 最高位为 JFS_EXT_UNWRITTEN 标记 */
+};
+
+struct juzfs_extent_idx {                                  /* 子树中的文件块均不小于 lblk */
+    uint32_t                lblk;
+    uint32_t                unused;
+    uint64_t                child;                         /* 子节点所在数据块 */
+};
+
+struct juzfs_extent_root {
+    struct juzfs_extent_header eh;
+    struct juzfs_extent     ee[JFS_EXT_ROOT_CNT];          /* depth > 0 时按 juzfs_extent_idx 解释 */
+};
+
+struct juzfs_dtree_header {                                /* 目录B+树节点，占一个数据块 */
+    uint16_t                magic;                         /* JFS_DTREE_MAGIC */
+    uint16_t                entries;
+    uint16_t                used;                          /* 叶子：记录区已用字节 */
+    uint16_t                depth;                         /* 到叶子的层数，0表示叶子 */
+    uint64_t                unused;
+};
+
+struct juzfs_dtree_idx {                                   /* 子树中的键均不小于 key，首项的 key 不作下界 */
+    uint64_t                key;
+    uint64_t                child;                         /* 子节点所在数据块 */
+};
+
+struct juzfs_dtree_rec {                                   /* 叶子中按 key 升序紧密排列，8字节对齐 */
+    uint64_t                key;                           /* jfs_dtree_key(name) */
+    uint32_t                ino;
+    uint8_t                 ftype;
+    uint8_t                 name_len;                      /* 不含结尾的 '\0' */
+    uint16_t                rec_len;                       /* JFS_DTREE_REC_LEN(name_len) */
+    char                    name[];
+};
+
+struct juzfs_dtree_ent {                                   /* 从B+树取出的一项 */
+    uint64_t                key;                           /* 同时是 readdir 的 cookie */
+    uint32_t                ino;
+    JFS_FILE_TYPE           ftype;
+    char                    name[MAX_NAME_LEN];
 };
 
 struct juzfs_inode {
     uint32_t                ino;
-    int                     size;                           /* 文件已占用空间 */ //handled by func 0 if dir
+    uint64_t                size;                           /* 文件已占用空间 */ //handled by func 0 if dir
     // char                 target_path[SFS_MAX_FILE_NAME]; /* store traget path when it is a symlink */
     int                     dir_cnt;
+    int                     dir_loaded;                     /* dentrys 已用的槽数，含空槽；其余目录项仍在目录块中 */
+    int                     dir_holes;                      /* 删除留下的空槽数 */
+    uint64_t                dir_seq;                        /* 最近分配的 readdir cookie */
+    uint64_t                dir_rd_ofs;                     /* 变长目录项下次读入的字节偏移 */
     struct juzfs_dentry*    dentry;                         /* 指向该inode的dentry */
 
     // arranged by func
-    struct juzfs_dentry*    dentrys;                        /* 所有目录项 */
-    int                     dentrys_list_size;
-
-
-    uint64_t                data_offsets[JFS_DATA_PER_FILE];// size = 6
+    struct juzfs_dentry**   dentrys;                        /* 所有目录项，readdir 与写回的顺序 */
+    int                     dentrys_list_size;              /* dentrys 的容量 */
+    struct juzfs_dentry**   dtab;                           /* 按名字哈希的开放寻址表 (juzfs_dir.c) */
+    int                     dtab_size;                      /* 2的幂，0 表示未建立 */
+
+    struct juzfs_extent_root ext_root;                      /* 文件块到数据块的映射 */
+    struct juzfs_extent     ext_last;                       /* 上次查找命中的区段，len为0表示无效 */
+
+    uint32_t                flags;                          /* JFS_INODE_INLINE / JFS_INODE_DIRENT_VAR / JFS_INODE_DTREE */
+    uint8_t*                inline_data;                    /* 内联文件的内容，JFS_INLINE_MAX() 字节 */
+
+    bool                    dirty;                          /* inode有改动未写回，挂在 super.dirty_inodes 上 */
+    int                     dir_dirty;                      /* 平铺目录：dentrys 中此槽及之后的项须重写，JFS_DIR_CLEAN 表示无 */
+    uint64_t                dirtied_at;                     /* 挂上脏链表的时刻 (ms) */
+    struct juzfs_inode*     dirty_next;
+    struct juzfs_inode**    dirty_pprev;
 };
 
 struct juzfs_dentry {
@@ -124,17 +324,139 @@ struct juzfs_dentry {
     // struct sfs_dentry* brother;                       /* 兄弟 */
     struct juzfs_inode*     inode;                         /* 指向inode */
     JFS_FILE_TYPE           ftype;
+    uint32_t                hash;                          /* jfs_name_hash(name) */
+    int                     idx;                           /* 在父目录 dentrys 中的下标 */
+    uint64_t                cookie;                        /* 目录内按 dentrys 顺序递增，readdir 的续读位置 */
+    struct juzfs_dcache_ent* dcache;                       /* 引用该dentry的路径缓存项 */
+};
+
+/**
+ * 路径缓存：完整路径 -> dentry，hash + LRU 双链表；负项记录“父目录存在但没有该名字”，
+ * 此时 dentry 指向父目录。每项同时挂在所引用 dentry 的链表上，dentry 释放时一并失效
+ */
+struct juzfs_dcache_ent {
+    uint32_t                hash;                          /* jfs_name_hash(path) */
+    bool                    negative;
+    struct juzfs_dentry*    dentry;
+    struct juzfs_dcache_ent* hash_next;
+    struct juzfs_dcache_ent* lru_prev;                     /* 头部为最近使用 */
+    struct juzfs_dcache_ent* lru_next;
+    struct juzfs_dcache_ent* d_next;                       /* 同一dentry的缓存项 */
+    struct juzfs_dcache_ent** d_pprev;
+    char                    path[JFS_DCACHE_PATH_LEN];     /* 空串表示空闲 */
+};
+
+struct juzfs_dcache_stats {
+    uint64_t                hit;
+    uint64_t                neg_hit;                       /* 命中负项 */
+    uint64_t                miss;
+    uint64_t                evict;
+    uint64_t                invalidate;                    /* 因名字空间变化失效的项数 */
+};
+
+struct juzfs_dcache {
+    int                     nents;                         /* 0 表示缓存关闭 */
+    int                     nbuckets;                      /* 2的幂 */
+    struct juzfs_dcache_ent* ents;
+    struct juzfs_dcache_ent* free;                         /* 空闲链表，经hash_next串联 */
+    struct juzfs_dcache_ent** buckets;
+    struct juzfs_dcache_ent lru;                           /* 哨兵 */
+    struct juzfs_dcache_stats stats;
+};
+
+/**
+ * 块缓存：以设备块 (JFS_BLK_SZ) 为单位，hash + LRU 双链表
+ */
+struct juzfs_buf {
+    uint64_t                blkno;                         /* 设备块号 */
+    uint8_t*                data;
+    int                     flags;                         /* JFS_BUF_DIRTY */
+    uint64_t                dirtied_at;                    /* 变脏的时刻 (ms) */
+    struct juzfs_buf*       hash_next;
+    struct juzfs_buf*       lru_prev;                      /* 头部为最近使用 */
+    struct juzfs_buf*       lru_next;
+};
+
+/**
+ * 设备块区间 [start, start + len)，fsync 按此挑出属于一个inode的脏块
+ */
+struct juzfs_range {
+    uint64_t                start;
+    uint64_t                len;
+};
+
+/**
+ * 向量IO的一段：设备字节偏移、内存缓冲区、长度
+ */
+struct juzfs_iovec {
+    uint64_t                offset;
+    uint8_t*                buf;
+    int                     size;
+};
+
+struct juzfs_cache_stats {
+    uint64_t                hit;
+    uint64_t                miss;
+    uint64_t                evict;
+    uint64_t                writeback;                     /* 回写块数 */
+    uint64_t                ra_issued;                     /* 预读装入块数 */
+    uint64_t                ra_hit;                        /* 预读块被访问次数 */
 };
 
+struct juzfs_cache {
+    int                     nbufs;                         /* 0 表示缓存关闭 */
+    int                     nbuckets;                      /* 2的幂 */
+    struct juzfs_buf*       bufs;
+    struct juzfs_buf*       free;                          /* 空闲链表，经hash_next串联 */
+    uint8_t*                slab;
+    struct juzfs_buf**      buckets;
+    struct juzfs_buf        lru;                           /* 哨兵 */
+    struct juzfs_cache_stats stats;
+    int                     ndirty;
+    int                     dirty_limit;                   /* 脏块数达到此值时唤醒后台回写，0表示不唤醒 */
+
+    struct juzfs_io*        ra_io;                         /* 已提交未收割的预读 */
+    int                     ra_iocnt;
+    int                     ra_max;                        /* 单次预读块数上限 */
+    uint8_t*                ra_staging;
+};
+
+/**
+ * 打开文件的顺序读检测状态，保存在 fi->fh 中
+ */
+struct juzfs_file {
+    off_t                   next_ofs;                      /* 顺序读时下一次读的偏移 */
+    int                     ra_window;                     /* 当前预读窗口 (块)，0 表示随机读 */
+    int                     ra_end;                        /* 预读已覆盖到的文件块号 */
+    struct juzfs_file*      free_next;                     /* 空闲链表 */
+};
+
+struct juzfs_arena_chunk {
+    struct juzfs_arena_chunk* prev;
+    struct juzfs_arena_chunk* next;
+    size_t                  cap;
+    size_t                  top;                           /* 已分配字节数 */
+    uint8_t                 data[];
+};
+
+struct juzfs_arena_mark {
+    struct juzfs_arena_chunk* chunk;
+    size_t                  top;
+};
+
+void* jfs_malloc(size_t);                                  /* juzfs_arena.c */
+uint32_t jfs_name_hash(const char*);                       /* juzfs_dir.c */
+
 //好用的初始化函数
 static inline struct juzfs_dentry* new_dentry(char * name, struct juzfs_dentry* parent, JFS_FILE_TYPE ftype) {
-    struct juzfs_dentry * dentry = (struct juzfs_dentry *)malloc(sizeof(struct juzfs_dentry));
+    struct juzfs_dentry * dentry = (struct juzfs_dentry *)jfs_malloc(sizeof(struct juzfs_dentry));
     memset(dentry, 0, sizeof(struct juzfs_dentry));
     JFS_ASSIGN_NAME(dentry, name);
     dentry->ftype   = ftype;
     dentry->ino     = -1;
     dentry->inode   = NULL;
     dentry->parent  = parent;
+    dentry->hash    = jfs_name_hash(dentry->name);
     return dentry;
 }
 
@@ -154,20 +476,45 @@ struct juzfs_super_d {
     uint64_t        ino_list_blks;
     uint64_t        ino_list_offset;
     uint64_t        data_offset;
+
+    uint32_t        flags;          /* JFS_SUPER_CLEAN，旧镜像此处为0，挂载时重建计数 */
+    int             free_inodes;
+    int             free_data_blks;
+    uint32_t        unused;         /* 旧版本此处为结构体尾部填充，内容未定义 */
+
+    uint32_t        layout_version; /* JFS_LAYOUT_LEGACY / JFS_LAYOUT_PACKED */
+    int             sz_inode;       /* JFS_LAYOUT_PACKED 时的inode槽大小 */
 };
 
 struct juzfs_inode_d {
     uint32_t        ino;
-    int             size;     
+    int             dir_cnt;
+    uint64_t        size;
+    JFS_FILE_TYPE   ftype;
+    uint32_t        flags;                              /* JFS_INODE_INLINE 时内容紧随其后 */
+    struct juzfs_extent_root ext_root;                  /* 区段树根节点 */
+};
+
+struct juzfs_inode_legacy_d {                           /* 区段树之前的inode，只出现在 JFS_LAYOUT_LEGACY 镜像中 */
+    uint32_t        ino;
+    int             size;
     int             dir_cnt;
     JFS_FILE_TYPE   ftype;
-    uint64_t        data_offsets[JFS_DATA_PER_FILE];    // size = 6
+    uint64_t        data_offsets[JFS_DATA_PER_FILE];    /* 文件前 size 字节、目录前 dir_cnt 项所在的块 */
 };
 
-struct juzfs_dentry_d {
+struct juzfs_dentry_d {                                 /* 旧目录的定长目录项 */
     char            name[MAX_NAME_LEN];
     uint32_t        ino;
     JFS_FILE_TYPE   ftype;
 };
 
+struct juzfs_dirent_d {                                 /* 变长目录项，4字节对齐，可跨块存放 */
+    uint32_t        ino;
+    uint8_t         ftype;
+    uint8_t         name_len;                           /* 不含结尾的 '\0' */
+    uint16_t        rec_len;                            /* JFS_DIRENT_LEN(name_len) */
+    char            name[];
+};
+
 #endif /* _TYPES_H_ */
@@ -1,6 +1,7 @@
 #include "juzfs.h"
 #include "types.h"
 #include <asm-generic/errno-base.h>
+#include <linux/falloc.h>
 #include <stdbool.h>
 #include <stdio.h>
 
@@ -14,32 +15,84 @@
 *******************************************************************************/
 static const struct fuse_opt option_spec[] = {		/* 用于FUSE文件系统解析参数 */
 	OPTION("--device=%s", device),
+	OPTION("--cache_size=%d", cache_size),
+	OPTION("--backend=%s", backend),
+	OPTION("--queue_depth=%d", queue_depth),
+	OPTION("--inode_size=%d", inode_size),
+	OPTION("--dcache_size=%d", dcache_size),
+	OPTION("--writeback_ms=%d", writeback_ms),
+	OPTION("--dirty_expire_ms=%d", dirty_expire_ms),
+	OPTION("--dirty_ratio=%d", dirty_ratio),
 	FUSE_OPT_END
 };
 
 struct custom_options juzfs_options;			 /* 全局选项 */
 struct juzfs_super super; 
+/******************************************************************************
+* SECTION: 加锁包装
+* FUSE 以多线程分发请求，各操作与后台回写线程经全局锁串行执行
+*******************************************************************************/
+#define JFS_LOCKED(name, params, args)	\
+	static int name##_locked params {	\
+		int ret;						\
+		jfs_lock();						\
+		ret = name args;				\
+		jfs_unlock();					\
+		return ret;						\
+	}
+
+JFS_LOCKED(juzfs_mkdir, (const char* path, mode_t mode), (path, mode))
+JFS_LOCKED(juzfs_getattr, (const char* path, struct stat* st), (path, st))
+JFS_LOCKED(juzfs_readdir, (const char* path, void* buf, fuse_fill_dir_t filler, off_t offset,
+						   struct fuse_file_info* fi), (path, buf, filler, offset, fi))
+JFS_LOCKED(juzfs_mknod, (const char* path, mode_t mode, dev_t dev), (path, mode, dev))
+JFS_LOCKED(juzfs_write, (const char* path, const char* buf, size_t size, off_t offset,
+						 struct fuse_file_info* fi), (path, buf, size, offset, fi))
+JFS_LOCKED(juzfs_read, (const char* path, char* buf, size_t size, off_t offset,
+						struct fuse_file_info* fi), (path, buf, size, offset, fi))
+JFS_LOCKED(juzfs_utimens, (const char* path, const struct timespec tv[2]), (path, tv))
+JFS_LOCKED(juzfs_truncate, (const char* path, off_t offset), (path, offset))
+JFS_LOCKED(juzfs_fallocate, (const char* path, int mode, off_t offset, off_t length,
+							 struct fuse_file_info* fi), (path, mode, offset, length, fi))
+JFS_LOCKED(juzfs_unlink, (const char* path), (path))
+JFS_LOCKED(juzfs_rmdir, (const char* path), (path))
+JFS_LOCKED(juzfs_rename, (const char* from, const char* to), (from, to))
+JFS_LOCKED(juzfs_open, (const char* path, struct fuse_file_info* fi), (path, fi))
+JFS_LOCKED(juzfs_release, (const char* path, struct fuse_file_info* fi), (path, fi))
+JFS_LOCKED(juzfs_flush, (const char* path, struct fuse_file_info* fi), (path, fi))
+JFS_LOCKED(juzfs_fsync, (const char* path, int datasync, struct fuse_file_info* fi), (path, datasync, fi))
+JFS_LOCKED(juzfs_fsyncdir, (const char* path, int datasync, struct fuse_file_info* fi), (path, datasync, fi))
+JFS_LOCKED(juzfs_opendir, (const char* path, struct fuse_file_info* fi), (path, fi))
+JFS_LOCKED(juzfs_access, (const char* path, int type), (path, type))
+JFS_LOCKED(juzfs_statfs, (const char* path, struct statvfs* stbuf), (path, stbuf))
+
 /******************************************************************************
 * SECTION: FUSE操作定义
 *******************************************************************************/
 static struct fuse_operations operations = {
-	.init = juzfs_init,						 /* mount文件系统 */		
+	.init = juzfs_init,						 /* mount文件系统，启动后台回写 */		
 	.destroy = juzfs_destroy,				 /* umount文件系统 */
-	.mkdir = juzfs_mkdir,					 /* 建目录，mkdir */
-	.getattr = juzfs_getattr,				 /* 获取文件属性，类似stat，必须完成 */
-	.readdir = juzfs_readdir,				 /* 填充dentrys */
-	.mknod = juzfs_mknod,					 /* 创建文件，touch相关 */
-	.write = juzfs_write,								  	 /* 写入文件 */
-	.read = juzfs_read,								  	 /* 读文件 */
-	.utimens = juzfs_utimens,				 /* 修改时间，忽略，避免touch报错 */
-	.truncate = juzfs_truncate,						  		 /* 改变文件大小 */
-	.unlink = juzfs_unlink,							  		 /* 删除文件 */
-	.rmdir	= juzfs_rmdir,							  		 /* 删除目录， rm -r */
-	.rename = juzfs_rename,							  		 /* 重命名，mv */
-
-	.open = juzfs_open,							
-	.opendir = juzfs_opendir,
-	.access = juzfs_access
+	.mkdir = juzfs_mkdir_locked,			 /* 建目录，mkdir */
+	.getattr = juzfs_getattr_locked,		 /* 获取文件属性，类似stat，必须完成 */
+	.readdir = juzfs_readdir_locked,		 /* 填充dentrys */
+	.mknod = juzfs_mknod_locked,			 /* 创建文件，touch相关 */
+	.write = juzfs_write_locked,							 /* 写入文件 */
+	.read = juzfs_read_locked,								 /* 读文件 */
+	.utimens = juzfs_utimens_locked,		 /* 修改时间，忽略，避免touch报错 */
+	.truncate = juzfs_truncate_locked,						 /* 改变文件大小 */
+	.fallocate = juzfs_fallocate_locked,	 /* 预分配空间，需 FUSE 2.9.1 及以上 */
+	.unlink = juzfs_unlink_locked,							 /* 删除文件 */
+	.rmdir	= juzfs_rmdir_locked,							 /* 删除目录， rm -r */
+	.rename = juzfs_rename_locked,							 /* 重命名，mv */
+
+	.open = juzfs_open_locked,							
+	.release = juzfs_release_locked,		 /* 释放打开文件的预读状态 */
+	.flush = juzfs_flush_locked,			 /* close，不强制写回 */
+	.fsync = juzfs_fsync_locked,			 /* 只写回该文件的改动并落盘 */
+	.fsyncdir = juzfs_fsyncdir_locked,
+	.opendir = juzfs_opendir_locked,
+	.access = juzfs_access_locked,
+	.statfs = juzfs_statfs_locked			 /* 容量统计，df */
 };
 /******************************************************************************
 * SECTION: 必做函数实现
@@ -56,6 +109,9 @@ void* juzfs_init(struct fuse_conn_info * conn_info) {
 		fuse_exit(fuse_get_context()->fuse);
 		return NULL;
 	} 
+	if (jfs_wb_start(juzfs_options) != 0) {		 /* 失败时改动只在 fsync 与卸载时写出 */
+		SFS_DBG("[%s] writeback thread not started\n", __func__);
+	}
 	return NULL;
 }
 
@@ -66,6 +122,7 @@ void* juzfs_init(struct fuse_conn_info * conn_info) {
  * @return void
  */
 void juzfs_destroy(void* p) {
+	jfs_wb_stop();
 	if (jfs_umount() != 0) {
 		SFS_DBG("[%s] unmount error\n", __func__);
 		fuse_exit(fuse_get_context()->fuse);
@@ -85,10 +142,14 @@ int juzfs_mkdir(const char* path, mode_t mode) {
 	(void)mode;
 	bool is_find, is_root;
 	char* fname;
+	int   ret;
 	struct juzfs_dentry* last_dentry = jfs_lookup(path, &is_find, &is_root);
 	struct juzfs_dentry* dentry;
 	// struct juzfs_inode*  inode;
 
+	if (last_dentry == NULL) {
+		return -EIO;
+	}
 	// 我们希望 path未找到，但是lookup返回上一级的dentry，且其为目录文件
 	// 如: /a/b/c -> dentry of /a/b, 且 /a/b 为目录
 	if (is_find) {
@@ -102,9 +163,20 @@ int juzfs_mkdir(const char* path, mode_t mode) {
 	}
 
 	fname  = jfs_get_name(path);
+	if (strlen(fname) >= MAX_NAME_LEN) {
+		return -ENAMETOOLONG;
+	}
 	dentry = new_dentry(fname, last_dentry,DIR_TYPE);
-	jfs_alloc_inode(dentry);
-	jfs_alloc_dentry(last_dentry->inode, dentry, true);
+	if (jfs_alloc_inode(dentry) == (void*)-ENOSPC) {
+		free(dentry);
+		return -ENOSPC;
+	}
+	if ((ret = jfs_alloc_dentry(last_dentry->inode, dentry, true)) < 0) {
+		juzfs_drop_inode(dentry->inode);
+		free(dentry);
+		return ret;
+	}
+	jfs_dcache_forget_path(path);					  /* 清除该路径的负项 */
 	// jfs_sync_inode(inode);
 	// jfs_sync_inode(inode->dentry->parent->inode);
 	
@@ -112,38 +184,53 @@ int juzfs_mkdir(const char* path, mode_t mode) {
 }
 
 /**
- * @brief 获取文件或目录的属性，该函数非常重要
+ * @brief 由inode填充文件属性，getattr 与 readdir 共用
  * 
- * @param path 相对于挂载点的路径
- * @param juzfs_stat 返回状态
- * @return int 0成功，否则失败
+ * @param inode 
+ * @param juzfs_stat 
  */
-int juzfs_getattr(const char* path, struct stat * juzfs_stat) {
-	bool	is_find, is_root;
-	struct juzfs_dentry* dentry = jfs_lookup(path, &is_find, &is_root);
-	if (is_find == false) {
-		return -ENOENT;
-	}
-
-	if (JFS_IS_DIR(dentry->inode)) {
+static void jfs_fill_stat(struct juzfs_inode* inode, struct stat * juzfs_stat) {
+	if (JFS_IS_DIR(inode)) {
 		juzfs_stat->st_mode = S_IFDIR | JFS_DEFAULT_PERM;
-		juzfs_stat->st_size = dentry->inode->dir_cnt * sizeof(struct juzfs_dentry_d);
+		juzfs_stat->st_size = JFS_IS_DIRENT_VAR(inode) ? inode->size :
+							  inode->dir_cnt * sizeof(struct juzfs_dentry_d);
 	}
-	else if (JFS_IS_FILE(dentry->inode)) {
+	else if (JFS_IS_FILE(inode)) {
 		juzfs_stat->st_mode = S_IFREG | JFS_DEFAULT_PERM;
-		juzfs_stat->st_size = dentry->inode->size;
+		juzfs_stat->st_size = inode->size;
 	}
 	// else if (SFS_IS_SYM_LINK(dentry->inode)) {
 	// 	juzfs_stat->st_mode = S_IFLNK | SFS_DEFAULT_PERM;
 	// 	juzfs_stat->st_size = dentry->inode->size;
 	// }
 
+	juzfs_stat->st_ino	 = inode->ino;
 	juzfs_stat->st_nlink = 1;
 	juzfs_stat->st_uid 	 = getuid();
 	juzfs_stat->st_gid 	 = getgid();
 	juzfs_stat->st_atime   = time(NULL);
 	juzfs_stat->st_mtime   = time(NULL);
 	juzfs_stat->st_blksize = JFS_BLK_SZ();
+}
+
+/**
+ * @brief 获取文件或目录的属性，该函数非常重要
+ * 
+ * @param path 相对于挂载点的路径
+ * @param juzfs_stat 返回状态
+ * @return int 0成功，否则失败
+ */
+int juzfs_getattr(const char* path, struct stat * juzfs_stat) {
+	bool	is_find, is_root;
+	struct juzfs_dentry* dentry = jfs_lookup(path, &is_find, &is_root);
+	if (dentry == NULL) {
+		return -EIO;
+	}
+	if (is_find == false) {
+		return -ENOENT;
+	}
+
+	jfs_fill_stat(dentry->inode, juzfs_stat);
 
 	if (is_root) {
 		juzfs_stat->st_size	= super.sz_usage; 
@@ -153,6 +240,42 @@ int juzfs_getattr(const char* path, struct stat * juzfs_stat) {
 	return 0;
 }
 
+/**
+ * @brief readdir 给出的子项属性：子inode已在内存时给出完整属性，否则只给出inode号与类型，不为此读入inode
+ */
+static void jfs_fill_child_stat(struct juzfs_inode* child, uint32_t ino, JFS_FILE_TYPE ftype, struct stat * st) {
+	memset(st, 0, sizeof(struct stat));
+	if (child != NULL) {
+		jfs_fill_stat(child, st);
+	}
+	else {
+		st->st_ino  = ino;
+		st->st_mode = ftype == DIR_TYPE ? S_IFDIR : S_IFREG;
+	}
+}
+
+/**
+ * @brief B+树目录按键序分批取出子项，键即cookie
+ */
+static int jfs_readdir_dtree(struct juzfs_inode* inode, void * buf, fuse_fill_dir_t filler, off_t offset) {
+	struct juzfs_dtree_ent ents[JFS_DTREE_SCAN_BATCH];
+	struct juzfs_dentry*   sub_dentry;
+	struct stat st;
+	int n;
+
+	while ((n = jfs_dtree_scan(inode, offset, ents, JFS_DTREE_SCAN_BATCH)) > 0) {
+		for (int i = 0; i < n; i++) {
+			sub_dentry = jfs_dir_find(inode, ents[i].name);
+			jfs_fill_child_stat(sub_dentry != NULL ? sub_dentry->inode : NULL, ents[i].ino, ents[i].ftype, &st);
+			if (filler(buf, ents[i].name, &st, ents[i].key) != 0) {
+				return 0;
+			}
+		}
+		offset = ents[n - 1].key;
+	}
+	return n;
+}
+
 /**
  * @brief 遍历目录项，填充至buf，并交给FUSE输出
  * 
@@ -164,31 +287,41 @@ int juzfs_getattr(const char* path, struct stat * juzfs_stat) {
  *				const struct stat *stbuf, off_t off)
  * buf: name会被复制到buf中
  * name: dentry名字
- * stbuf: 文件状态，可忽略
- * off: 下一次offset从哪里开始，这里可以理解为第几个dentry
+ * stbuf: 文件状态，见 jfs_fill_child_stat
+ * off: 下一次offset从哪里开始，这里为该项的cookie（B+树目录为名字的键）；buf写满时返回1
  * 
- * @param offset 第几个目录项？
+ * @param offset 上次输出的最后一项的cookie，0表示从头开始
  * @param fi 可忽略
  * @return int 0成功，否则失败
  */
 int juzfs_readdir(const char * path, void * buf, fuse_fill_dir_t filler, off_t offset,
 			    		 struct fuse_file_info * fi) {
     bool	is_find, is_root;
-	int		cur_dir = offset;
+	struct stat st;
 
 	struct juzfs_dentry* dentry = jfs_lookup(path, &is_find, &is_root);
 	struct juzfs_dentry* sub_dentry;
 	struct juzfs_inode* inode;
-	if (is_find) {
-		inode = dentry->inode;
-		sub_dentry = jfs_get_dentry(inode, cur_dir);
-		if (sub_dentry) {
-			filler(buf, sub_dentry->name, NULL, ++offset);
+	if (dentry == NULL) {
+		return -EIO;
+	}
+	if (!is_find) {
+		printf("Not found\n");
+		return -ENOENT;
+	}
+
+	inode = dentry->inode;
+	if (JFS_IS_DTREE(inode)) {
+		return jfs_readdir_dtree(inode, buf, filler, offset);
+	}
+	for (sub_dentry = jfs_get_dentry(inode, offset); sub_dentry != NULL;
+		 sub_dentry = jfs_get_dentry(inode, sub_dentry->cookie)) {	/* 一次填满buf */
+		jfs_fill_child_stat(sub_dentry->inode, sub_dentry->ino, sub_dentry->ftype, &st);
+		if (filler(buf, sub_dentry->name, &st, sub_dentry->cookie) != 0) {
+			break;
 		}
-		return 0;
 	}
-	printf("Not found\n");
-	return -ENOENT;
+	return 0;
 }
 
 /**
@@ -206,13 +339,20 @@ int juzfs_mknod(const char* path, mode_t mode, dev_t dev) {
 	struct juzfs_dentry* dentry;
 	// struct juzfs_inode* inode;
 	char* fname;
+	int   ret;
 	
+	if (last_dentry == NULL) {
+		return -EIO;
+	}
 	if (is_find == true) {
 		// SFS_DBG("File Already Exists");
 		return -EEXIST;
 	}
 
 	fname = jfs_get_name(path);
+	if (strlen(fname) >= MAX_NAME_LEN) {
+		return -ENAMETOOLONG;
+	}
 	
 	if (S_ISREG(mode)) {
 		dentry = new_dentry(fname,last_dentry, FILE_TYPE);
@@ -223,8 +363,16 @@ int juzfs_mknod(const char* path, mode_t mode, dev_t dev) {
 	else {
 		dentry = new_dentry(fname, last_dentry, FILE_TYPE);
 	}
-	jfs_alloc_inode(dentry);
-	jfs_alloc_dentry(last_dentry->inode, dentry,true);
+	if (jfs_alloc_inode(dentry) == (void*)-ENOSPC) {
+		free(dentry);
+		return -ENOSPC;
+	}
+	if ((ret = jfs_alloc_dentry(last_dentry->inode, dentry, true)) < 0) {
+		juzfs_drop_inode(dentry->inode);
+		free(dentry);
+		return ret;
+	}
+	jfs_dcache_forget_path(path);					  /* 清除该路径的负项 */
 
 	return 0;
 }
@@ -258,7 +406,12 @@ int juzfs_write(const char* path, const char* buf, size_t size, off_t offset,
 	bool	is_find, is_root;
 	struct juzfs_dentry* dentry = jfs_lookup(path, &is_find, &is_root);
 	struct juzfs_inode*  inode;
+	uint64_t             old_size;
+	int                  ret;
 	
+	if (dentry == NULL) {
+		return -EIO;
+	}
 	if (is_find == false) {
 		return -ENOENT;
 	}
@@ -269,34 +422,28 @@ int juzfs_write(const char* path, const char* buf, size_t size, off_t offset,
 		return -EISDIR;	
 	}
 
-	if (inode->size < offset) {
-		return -ESPIPE;
+	old_size = inode->size;
+	if (offset + size > inode->size) {				  /* 先扩展文件大小，越过文件尾留下的部分是空洞 */
+		ret = juzfs_truncate(path, offset + size);
+		if (ret != 0) {
+			return ret;
+		}
 	}
 
-	int start_blk = offset/JFS_BLK_SZ();
-	int end_blk = (size+offset)/JFS_BLK_SZ();
-
-	for (int i = start_blk;i < end_blk + 1; i++) {
-		off_t loc = (i == start_blk) ? inode->data_offsets[start_blk] + offset : inode->data_offsets[i];
-		int length;
-		if (start_blk == end_blk) {
-			length = size;
-		} else if (i == start_blk) {
-			length = JFS_BLK_SZ()-offset;
-		} else if (i == end_blk) {
-			length = (offset + size) % JFS_BLK_SZ();
-		} else {
-			length = JFS_BLK_SZ();
-		}
-		if (jfs_driver_write(loc, buf, length) != 0) {
-			return -EIO;
+	if (JFS_IS_INLINE(inode)) {						  /* 内容与inode一起写出，一次设备IO */
+		if (size > 0) {
+			memcpy(inode->inline_data + offset, buf, size);
 		}
-		buf += length;
+		return jfs_sync_inode(inode) != 0 ? -EIO : (int)size;
 	}
 
-	inode->size = offset + size > inode->size ? offset + size : inode->size;
-
-	return size;
+	ret = jfs_file_pwrite(inode, (const uint8_t *)buf, offset, size);	/* 空洞在此时才分配数据块 */
+	if (ret < (int)size) {							  /* 没写完的部分不计入文件大小 */
+		inode->size = offset + (ret > 0 ? ret : 0);
+		inode->size = inode->size > old_size ? inode->size : old_size;
+		jfs_inode_mark_dirty(inode);
+	}
+	return ret;
 }
 
 /**
@@ -314,7 +461,13 @@ int juzfs_read(const char* path, char* buf, size_t size, off_t offset,
 	bool	is_find, is_root;
 	struct juzfs_dentry* dentry = jfs_lookup(path, &is_find, &is_root);
 	struct juzfs_inode*  inode;
+	struct juzfs_iovec*  iov;
+	struct juzfs_arena_mark mark;
+	int                  iovcnt;
 
+	if (dentry == NULL) {
+		return -EIO;
+	}
 	if (is_find == false) {
 		return -ENOENT;
 	}
@@ -325,29 +478,36 @@ int juzfs_read(const char* path, char* buf, size_t size, off_t offset,
 		return -EISDIR;	
 	}
 
-	if (inode->size < offset) {
-		return -ESPIPE;
+	if (inode->size <= (uint64_t)offset) {
+		return 0;
 	}
 
-	int start_blk = offset/JFS_BLK_SZ();
-	int end_blk = (size+offset)/JFS_BLK_SZ();
-	
-	for (int i = start_blk;i < end_blk+1; i++) {
-		off_t loc = (i == start_blk) ? inode->data_offsets[start_blk] + offset : inode->data_offsets[i];
-		int length;
-		if (start_blk == end_blk) {
-			length = size;
-		} else if (i == start_blk) {
-			length = JFS_BLK_SZ()-offset;
-		} else if (i == end_blk) {
-			length = (offset + size) % JFS_BLK_SZ();
-		} else {
-			length = JFS_BLK_SZ();
-		}
-		if (jfs_driver_read(loc, buf, length) != 0) {
-			return -EIO;
+	if (offset + size > inode->size) {
+		size = inode->size - offset;
+	}
+
+	if (JFS_IS_INLINE(inode)) {						  /* 内容已随inode读入 */
+		if (size > 0) {
+			memcpy(buf, inode->inline_data + offset, size);
 		}
-		buf += length;
+		return size;
+	}
+
+	mark   = jfs_scratch_mark();
+	iov    = (struct juzfs_iovec*)jfs_scratch_alloc(sizeof(struct juzfs_iovec) * (size / JFS_BLK_SZ() + 2));
+	iovcnt = jfs_file_iovec(inode, (uint8_t *)buf, offset, size, iov, false);
+	if (iovcnt < 0) {								  /* 区段树节点读取失败 */
+		jfs_scratch_release(mark);
+		return iovcnt;
+	}
+	if (jfs_driver_readv(iov, iovcnt) != 0) {
+		jfs_scratch_release(mark);
+		return -EIO;
+	}
+	jfs_scratch_release(mark);
+
+	if (fi != NULL && fi->fh != 0) {				  /* 顺序读时异步预读后续数据块 */
+		jfs_file_readahead((struct juzfs_file*)(uintptr_t)fi->fh, inode, offset, size);
 	}
 	return size;			   
 }
@@ -363,6 +523,9 @@ int juzfs_unlink(const char* path) {
 	struct juzfs_dentry* dentry = jfs_lookup(path, &is_find, &is_root);
 	struct juzfs_inode*  inode;
 
+	if (dentry == NULL) {
+		return -EIO;
+	}
 	if (is_find == false) {
 		return -ENOENT;
 	}
@@ -405,6 +568,9 @@ int juzfs_rename(const char* from, const char* to) {
 	struct juzfs_inode*  from_inode;
 	struct juzfs_dentry* to_dentry;
 	mode_t mode = 0;
+	if (from_dentry == NULL) {
+		return -EIO;
+	}
 	if (is_find == false) {
 		return -ENOENT;
 	}
@@ -428,10 +594,27 @@ int juzfs_rename(const char* from, const char* to) {
 	}
 	
 	to_dentry = jfs_lookup(to, &is_find, &is_root);	  
+	if (to_dentry == NULL) {
+		return -EIO;
+	}
 	juzfs_drop_inode(to_dentry->inode);				  /* 保证生成的inode被释放 */	
 	to_dentry->ino = from_inode->ino;				  /* 指向新的inode */
 	to_dentry->inode = from_inode;
+	if (JFS_IS_DTREE(to_dentry->parent->inode)) {	  /* B+树中的项已按临时inode写出 */
+		jfs_dtree_update(to_dentry->parent->inode, to_dentry->name, to_dentry->ino);
+	} else {
+		jfs_dir_mark_dirty(to_dentry->parent->inode, to_dentry->idx);
+	}
+	from_inode->dentry = to_dentry;
+	for (int i = 0; i < from_inode->dir_loaded; i++) {	  /* 子项的parent随之改为新的dentry，未读入的读入时取新值 */
+		if (from_inode->dentrys[i] != NULL) {
+			from_inode->dentrys[i]->parent = to_dentry;
+		}
+	}
 	
+	if (JFS_IS_DIR(from_inode)) {					  /* 子孙的路径随之改变 */
+		jfs_dcache_forget_subtree(from);
+	}
 	juzfs_drop_dentry(from_dentry->parent->inode, from_dentry);
 	return ret;
 }
@@ -445,10 +628,75 @@ int juzfs_rename(const char* from, const char* to) {
  * @return int 0成功，否则失败
  */
 int juzfs_open(const char* path, struct fuse_file_info* fi) {
-	/* 选做 */
+	struct juzfs_file* file = jfs_file_alloc();	  /* 顺序读检测状态 */
+
+	if (file == NULL) {
+		return -ENOMEM;
+	}
+	fi->fh = (uint64_t)(uintptr_t)file;
+	return 0;
+}
+
+/**
+ * @brief 关闭文件，释放 open 时保存在 fi->fh 中的状态
+ * 
+ * @param path 相对于挂载点的路径
+ * @param fi 文件信息
+ * @return int 0成功
+ */
+int juzfs_release(const char* path, struct fuse_file_info* fi) {
+	if (fi->fh != 0) {
+		jfs_file_free((struct juzfs_file*)(uintptr_t)fi->fh);
+		fi->fh = 0;
+	}
 	return 0;
 }
 
+/**
+ * @brief 每次 close 时调用，不强制写回：改动由后台回写按时间与脏块比例写出，
+ * 需要持久化时由应用调用 fsync
+ * 
+ * @param path 相对于挂载点的路径
+ * @param fi 文件信息
+ * @return int 0成功
+ */
+int juzfs_flush(const char* path, struct fuse_file_info* fi) {
+	return 0;
+}
+
+/**
+ * @brief 只写回该文件的改动并让设备落盘，不等待其他文件的脏块
+ * 
+ * @param path 相对于挂载点的路径
+ * @param datasync 非0时为 fdatasync；inode中只有大小与块映射，都是读回数据所必需的，与 fsync 相同
+ * @param fi 文件信息
+ * @return int 0成功，否则失败
+ */
+int juzfs_fsync(const char* path, int datasync, struct fuse_file_info* fi) {
+	bool	is_find, is_root;
+	struct juzfs_dentry* dentry = jfs_lookup(path, &is_find, &is_root);
+
+	if (dentry == NULL) {
+		return -EIO;
+	}
+	if (is_find == false) {
+		return -ENOENT;
+	}
+	return jfs_fsync_inode(dentry->inode);
+}
+
+/**
+ * @brief 写回目录本身的改动（目录项的增删），子项各自 fsync
+ * 
+ * @param path 相对于挂载点的路径
+ * @param datasync 
+ * @param fi 文件信息
+ * @return int 0成功，否则失败
+ */
+int juzfs_fsyncdir(const char* path, int datasync, struct fuse_file_info* fi) {
+	return juzfs_fsync(path, datasync, fi);
+}
+
 /**
  * @brief 打开目录文件
  * 
@@ -472,7 +720,12 @@ int juzfs_truncate(const char* path, off_t offset) {
 	bool	is_find, is_root;
 	struct juzfs_dentry* dentry = jfs_lookup(path, &is_find, &is_root);
 	struct juzfs_inode*  inode;
+	uint64_t             pblk;
+	int                  ret;
 	
+	if (dentry == NULL) {
+		return -EIO;
+	}
 	if (is_find == false) {
 		return -EEXIST;
 	}
@@ -483,29 +736,121 @@ int juzfs_truncate(const char* path, off_t offset) {
 		return -EISDIR;
 	}
 
-	int new_blks = JFS_ROUND_UP(offset,JFS_BLK_SZ())/JFS_BLK_SZ();
-	int file_blks = JFS_ROUND_UP(inode->size,JFS_BLK_SZ()) /JFS_BLK_SZ();
+	if (JFS_ROUND_UP((uint64_t)offset, JFS_BLK_SZ()) / JFS_BLK_SZ() > JFS_EXT_MAX_BLKS) {
+		return -EFBIG;
+	}
 
-	if(new_blks > JFS_DATA_PER_FILE) {
-		return -ENOSPC;
+	if (JFS_IS_INLINE(inode)) {
+		if ((uint64_t)offset <= JFS_INLINE_MAX()) {	  /* 仍放得下，只改inode中的内容 */
+			return jfs_inline_resize(inode, offset);
+		}
+		ret = jfs_inline_promote(inode);			  /* 放不下，转为数据块 */
+		if (ret != 0) {
+			return ret;
+		}
 	}
 
-	//alloc blk
-	if(new_blks > file_blks) {
-		for (int i = file_blks; i < new_blks; i++){
-			inode->data_offsets[i] = jfs_alloc_data_blk();
+	if ((uint64_t)offset <= inode->size) {			  /* 扩展时不分配，留作空洞；不扩展时一并释放文件尾之后预分配的块 */
+		ret = jfs_extent_truncate(inode, JFS_ROUND_UP((uint64_t)offset, JFS_BLK_SZ()) / JFS_BLK_SZ());
+		if (ret != 0) {								  /* 文件尾之后的块仍在映射中，大小不变 */
+			return ret;
 		}
-	} else if (new_blks < file_blks) {
-		for (int i = file_blks; i < new_blks; i++) {
-			jfs_dealloc_data_blk(inode->data_offsets[i]);
+		if ((uint64_t)offset < inode->size && offset % JFS_BLK_SZ() != 0 &&	/* 末块中文件尾之后清零，再次扩展时读到零 */
+			jfs_extent_map(inode, offset / JFS_BLK_SZ(), &pblk) > 0 && 
+			pblk != JFS_EXT_HOLE && !JFS_EXT_IS_UNWRITTEN(pblk)) {
+			struct juzfs_arena_mark mark = jfs_scratch_mark();
+			int      tail = JFS_BLK_SZ() - offset % JFS_BLK_SZ();
+			uint8_t* zero = (uint8_t *)jfs_scratch_alloc(tail);
+
+			memset(zero, 0, tail);
+			ret = jfs_driver_write(JFS_DATA_OFS(pblk) + offset % JFS_BLK_SZ(), zero, tail);
+			jfs_scratch_release(mark);
+			if (ret != 0) {
+				return -EIO;
+			}
 		}
 	}
 
-	inode->size = offset;
+	if (inode->size != (uint64_t)offset) {
+		inode->size = offset;
+		jfs_inode_mark_dirty(inode);
+	}
 
 	return 0;
 }
 
+/**
+ * @brief 预分配文件空间：为 [offset, offset + length) 中的空洞保留尽量物理连续的数据块，
+ * 作为未写区段插入，读为零且不访问设备；之后顺序写入该区间时一次下发
+ * 
+ * @param path 相对于挂载点的路径
+ * @param mode 仅支持0与 FALLOC_FL_KEEP_SIZE（不改变文件大小）
+ * @param offset 起始偏移
+ * @param length 长度
+ * @param fi 可忽略
+ * @return int 0成功，否则失败
+ */
+int juzfs_fallocate(const char* path, int mode, off_t offset, off_t length,
+					struct fuse_file_info* fi) {
+	bool	is_find, is_root;
+	struct juzfs_dentry* dentry = jfs_lookup(path, &is_find, &is_root);
+	struct juzfs_inode*  inode;
+	uint64_t             end = (uint64_t)offset + length;
+	uint64_t             first, nblks;
+	int64_t              ret;
+
+	if (dentry == NULL) {
+		return -EIO;
+	}
+	if (is_find == false) {
+		return -ENOENT;
+	}
+	if (mode & ~FALLOC_FL_KEEP_SIZE) {
+		return -EOPNOTSUPP;
+	}
+	if (offset < 0 || length <= 0) {
+		return -EINVAL;
+	}
+
+	inode = dentry->inode;
+
+	if (JFS_IS_DIR(inode)) {
+		return -EISDIR;
+	}
+
+	if (JFS_ROUND_UP(end, JFS_BLK_SZ()) / JFS_BLK_SZ() > JFS_EXT_MAX_BLKS) {
+		return -EFBIG;
+	}
+
+	if (JFS_IS_INLINE(inode)) {
+		if (end <= JFS_INLINE_MAX()) {				  /* inode槽中的空间本就保留着 */
+			if ((mode & FALLOC_FL_KEEP_SIZE) || end <= inode->size) {
+				return 0;
+			}
+			return jfs_inline_resize(inode, end);
+		}
+		ret = jfs_inline_promote(inode);
+		if (ret != 0) {
+			return ret;
+		}
+	}
+
+	first = offset / JFS_BLK_SZ();
+	nblks = JFS_ROUND_UP(end, JFS_BLK_SZ()) / JFS_BLK_SZ() - first;
+	ret   = jfs_file_fill_holes(inode, first, nblks, true);
+	if (ret < 0) {
+		return ret;
+	}
+	if ((uint64_t)ret < nblks) {					  /* 已保留的部分不回收，截断或删除时释放 */
+		return -ENOSPC;
+	}
+
+	if (!(mode & FALLOC_FL_KEEP_SIZE) && end > inode->size) {
+		inode->size = end;
+		jfs_inode_mark_dirty(inode);
+	}
+	return 0;
+}
 
 /**
  * @brief 访问文件，因为读写文件时需要查看权限
@@ -545,6 +890,27 @@ int juzfs_access(const char* path, int type) {
 		break;
 	}
 	return is_access_ok ? 0 : -EACCES;
+}
+
+/**
+ * @brief 文件系统容量统计（df），直接取内存中的空闲计数，不扫描位图
+ * 
+ * @param path 相对于挂载点的路径
+ * @param stbuf 输出
+ * @return int 0成功
+ */
+int juzfs_statfs(const char* path, struct statvfs* stbuf) {
+	memset(stbuf, 0, sizeof(struct statvfs));
+	stbuf->f_bsize   = JFS_BLK_SZ();
+	stbuf->f_frsize  = JFS_BLK_SZ();
+	stbuf->f_blocks  = super.max_data_blks;
+	stbuf->f_bfree   = super.data_bm.nfree;
+	stbuf->f_bavail  = super.data_bm.nfree;
+	stbuf->f_files   = super.max_ino;
+	stbuf->f_ffree   = super.ino_bm.nfree;
+	stbuf->f_favail  = super.ino_bm.nfree;
+	stbuf->f_namemax = MAX_NAME_LEN - 1;
+	return 0;
 }	
 /******************************************************************************
 * SECTION: FUSE入口
@@ -555,6 +921,13 @@ int main(int argc, char **argv)
 	struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
 
 	juzfs_options.device = strdup("/home/200111323/ddriver");
+	juzfs_options.cache_size = JFS_DEFAULT_CACHE_SZ;
+	juzfs_options.queue_depth = JFS_DEFAULT_QUEUE_DEPTH;
+	juzfs_options.inode_size = JFS_DEFAULT_INODE_SZ;
+	juzfs_options.dcache_size = JFS_DEFAULT_DCACHE_SZ;
+	juzfs_options.writeback_ms = JFS_DEFAULT_WRITEBACK_MS;
+	juzfs_options.dirty_expire_ms = JFS_DEFAULT_DIRTY_EXPIRE_MS;
+	juzfs_options.dirty_ratio = JFS_DEFAULT_DIRTY_RATIO;
 
 	if (fuse_opt_parse(&args, &juzfs_options, option_spec, NULL) == -1)
 		return -1;
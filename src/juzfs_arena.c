@@ -0,0 +1,155 @@
+#include "juzfs.h"
+#include "types.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+extern struct juzfs_super super;
+
+/******************************************************************************
+* SECTION: 堆分配计数
+*******************************************************************************/
+static uint64_t jfs_heap_cnt;
+
+/**
+ * @brief 计数的 malloc，文件系统内部的堆分配均经过这里
+ *
+ * @param size
+ * @return void*
+ */
+void* jfs_malloc(size_t size) {
+    __atomic_add_fetch(&jfs_heap_cnt, 1, __ATOMIC_RELAXED);
+    return malloc(size);
+}
+
+void* jfs_calloc(size_t nmemb, size_t size) {
+    __atomic_add_fetch(&jfs_heap_cnt, 1, __ATOMIC_RELAXED);
+    return calloc(nmemb, size);
+}
+
+/**
+ * @brief 自启动以来的堆分配次数，稳态读写/getattr前后之差应为0
+ *
+ * @return uint64_t
+ */
+uint64_t jfs_heap_allocs(void) {
+    return __atomic_load_n(&jfs_heap_cnt, __ATOMIC_RELAXED);
+}
+
+/******************************************************************************
+* SECTION: 线程私有临时区 (bump 分配，按 mark/release 成对释放)
+* 每个线程一条 chunk 链，release 只回退游标，chunk 保留复用；
+* 只有临时区首次增长到稳态大小时才会访问堆。
+*******************************************************************************/
+static __thread struct juzfs_arena_chunk* arena;     /* 当前 chunk */
+static pthread_key_t  arena_key;
+static pthread_once_t arena_once = PTHREAD_ONCE_INIT;
+
+static void jfs_arena_free(void* head) {
+    struct juzfs_arena_chunk* chunk = (struct juzfs_arena_chunk*)head;
+    struct juzfs_arena_chunk* next;
+
+    while (chunk != NULL) {
+        next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+}
+
+static void jfs_arena_key_init(void) {
+    pthread_key_create(&arena_key, jfs_arena_free);
+}
+
+static struct juzfs_arena_chunk* jfs_arena_grow(struct juzfs_arena_chunk* prev, size_t size) {
+    struct juzfs_arena_chunk* chunk;
+    size_t cap = size > JFS_ARENA_CHUNK_SZ ? size : JFS_ARENA_CHUNK_SZ;
+
+    chunk = (struct juzfs_arena_chunk*)jfs_malloc(sizeof(struct juzfs_arena_chunk) + cap);
+    if (chunk == NULL) {
+        return NULL;
+    }
+    chunk->cap  = cap;
+    chunk->top  = 0;
+    chunk->prev = prev;
+    chunk->next = NULL;
+    if (prev != NULL) {                              /* 插在当前 chunk 之后，原后继保留 */
+        chunk->next = prev->next;
+        if (prev->next != NULL) {
+            prev->next->prev = chunk;
+        }
+        prev->next = chunk;
+    } else {
+        pthread_once(&arena_once, jfs_arena_key_init);
+        pthread_setspecific(arena_key, chunk);       /* 线程退出时释放整条链 */
+    }
+    return chunk;
+}
+
+/**
+ * @brief 从当前线程的临时区分配，按 JFS_ARENA_ALIGN 对齐；
+ * 须在同一线程内用 jfs_scratch_release 回退到此前的 mark
+ *
+ * @param size
+ * @return void*
+ */
+void* jfs_scratch_alloc(size_t size) {
+    struct juzfs_arena_chunk* chunk = arena;
+    uint8_t* ptr;
+
+    size = JFS_ROUND_UP(size, JFS_ARENA_ALIGN);
+    if (size == 0) {
+        size = JFS_ARENA_ALIGN;
+    }
+
+    if (chunk == NULL || chunk->top + size > chunk->cap) {
+        if (chunk != NULL && chunk->next != NULL && chunk->next->cap >= size) {
+            chunk = chunk->next;                      /* 复用已有 chunk */
+            chunk->top = 0;
+        } else {
+            chunk = jfs_arena_grow(chunk, size);
+            if (chunk == NULL) {
+                return NULL;
+            }
+        }
+        arena = chunk;
+    }
+
+    ptr         = chunk->data + chunk->top;
+    chunk->top += size;
+    return ptr;
+}
+
+/**
+ * @brief 记录当前线程临时区的位置
+ *
+ * @return struct juzfs_arena_mark
+ */
+struct juzfs_arena_mark jfs_scratch_mark(void) {
+    struct juzfs_arena_mark mark;
+
+    mark.chunk = arena;
+    mark.top   = arena != NULL ? arena->top : 0;
+    return mark;
+}
+
+/**
+ * @brief 释放 mark 之后的全部临时分配
+ *
+ * @param mark
+ */
+void jfs_scratch_release(struct juzfs_arena_mark mark) {
+    if (mark.chunk == NULL) {                        /* mark 时尚无 chunk，回到链首 */
+        if (arena == NULL) {
+            return;
+        }
+        while (arena->prev != NULL) {
+            arena = arena->prev;
+        }
+        arena->top = 0;
+        return;
+    }
+    arena      = mark.chunk;
+    arena->top = mark.top;
+}
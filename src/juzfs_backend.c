@@ -0,0 +1,300 @@
+#include "juzfs.h"
+#include "types.h"
+#include <linux/fs.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+extern struct juzfs_super super;
+
+/******************************************************************************
+* SECTION: ddriver 后端
+*******************************************************************************/
+#ifdef JFS_HAVE_DDRIVER
+/**
+ * @brief 移动磁头，磁头已在offset处时省去寻道
+ *
+ * @param fd
+ * @param offset 须与IO单位对齐
+ */
+static void jfs_ddriver_seek(int fd, uint64_t offset) {
+    if (super.head == offset) {
+        return;
+    }
+    ddriver_seek(fd, offset, SEEK_SET);
+    super.head = offset;
+}
+
+static int jfs_ddriver_open(const char* path) {
+    super.head = JFS_HEAD_UNKNOWN;
+    return ddriver_open((char*)path);
+}
+
+static int jfs_ddriver_read(int fd, uint64_t offset, uint8_t* buf, int size) {
+    jfs_ddriver_seek(fd, offset);
+    while (size != 0)
+    {
+        ddriver_read(fd, (char*)buf, JFS_IO_SZ());
+        buf          += JFS_IO_SZ();
+        size         -= JFS_IO_SZ();
+        super.head   += JFS_IO_SZ();
+    }
+    return 0;
+}
+
+static int jfs_ddriver_write(int fd, uint64_t offset, uint8_t* buf, int size) {
+    jfs_ddriver_seek(fd, offset);
+    while (size != 0)
+    {
+        ddriver_write(fd, (char*)buf, JFS_IO_SZ());
+        buf          += JFS_IO_SZ();
+        size         -= JFS_IO_SZ();
+        super.head   += JFS_IO_SZ();
+    }
+    return 0;
+}
+
+static int jfs_ddriver_disk_size(int fd, uint64_t* size) {
+    int sz;
+    int ret = ddriver_ioctl(fd, IOC_REQ_DEVICE_SIZE, &sz);
+
+    *size = sz;
+    return ret;
+}
+
+static int jfs_ddriver_io_size(int fd, int* size) {
+    return ddriver_ioctl(fd, IOC_REQ_DEVICE_IO_SZ, size);
+}
+
+static int jfs_ddriver_state(int fd, struct ddriver_state* state) {
+    return ddriver_ioctl(fd, IOC_REQ_DEVICE_STATE, state);
+}
+
+static const struct juzfs_backend jfs_ddriver_backend = {
+    .name       = "ddriver",
+    .open       = jfs_ddriver_open,
+    .close      = ddriver_close,
+    .read       = jfs_ddriver_read,
+    .write      = jfs_ddriver_write,
+    .disk_size  = jfs_ddriver_disk_size,
+    .io_size    = jfs_ddriver_io_size,
+    .state      = jfs_ddriver_state,
+};
+#endif /* JFS_HAVE_DDRIVER */
+
+/******************************************************************************
+* SECTION: 文件镜像后端 (pread/pwrite，无单独的寻道)
+*******************************************************************************/
+static struct ddriver_state jfs_file_stat;
+
+int jfs_file_open(const char* path) {
+    memset(&jfs_file_stat, 0, sizeof(struct ddriver_state));
+    return open(path, O_RDWR);
+}
+
+int jfs_file_read(int fd, uint64_t offset, uint8_t* buf, int size) {
+    ssize_t n;
+
+    jfs_file_stat.read_cnt += size / JFS_IO_SZ();
+    while (size > 0) {
+        n = pread(fd, buf, size, offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -EIO;
+        }
+        buf    += n;
+        offset += n;
+        size   -= n;
+    }
+    return 0;
+}
+
+int jfs_file_write(int fd, uint64_t offset, uint8_t* buf, int size) {
+    ssize_t n;
+
+    jfs_file_stat.write_cnt += size / JFS_IO_SZ();
+    while (size > 0) {
+        n = pwrite(fd, buf, size, offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -EIO;
+        }
+        buf    += n;
+        offset += n;
+        size   -= n;
+    }
+    return 0;
+}
+
+/**
+ * @brief 普通文件取文件大小，块设备取设备容量
+ */
+int jfs_file_disk_size(int fd, uint64_t* size) {
+    struct stat st;
+    uint64_t    bytes;
+
+    if (fstat(fd, &st) != 0) {
+        return -errno;
+    }
+    if (S_ISBLK(st.st_mode)) {
+        if (ioctl(fd, BLKGETSIZE64, &bytes) != 0) {
+            return -errno;
+        }
+        *size = bytes;
+        return 0;
+    }
+    *size = st.st_size;
+    return 0;
+}
+
+int jfs_file_io_size(int fd, int* size) {
+    struct stat st;
+
+    *size = JFS_FILE_IO_SZ;
+    if (fstat(fd, &st) == 0 && S_ISBLK(st.st_mode)) {
+        ioctl(fd, BLKSSZGET, size);
+    }
+    return 0;
+}
+
+int jfs_file_state(int fd, struct ddriver_state* state) {
+    *state = jfs_file_stat;
+    return 0;
+}
+
+/**
+ * @brief 异步提交的IO计入设备计数
+ */
+void jfs_file_count(struct juzfs_io* io) {
+    if (io->is_write) {
+        jfs_file_stat.write_cnt += io->size / JFS_IO_SZ();
+    } else {
+        jfs_file_stat.read_cnt  += io->size / JFS_IO_SZ();
+    }
+}
+
+/**
+ * @brief 已写入的数据从宿主页缓存落到存储，fsync 与卸载时调用
+ */
+int jfs_file_sync(int fd) {
+    while (fdatasync(fd) != 0) {
+        if (errno != EINTR) {
+            return -errno;
+        }
+    }
+    return 0;
+}
+
+static const struct juzfs_backend jfs_file_backend = {
+    .name       = "file",
+    .open       = jfs_file_open,
+    .close      = close,
+    .read       = jfs_file_read,
+    .write      = jfs_file_write,
+    .disk_size  = jfs_file_disk_size,
+    .io_size    = jfs_file_io_size,
+    .state      = jfs_file_state,
+    .sync       = jfs_file_sync,
+};
+
+/******************************************************************************
+* SECTION: 内存映射后端 (整个镜像 mmap，读写直接访问映射区，msync 落盘)
+*******************************************************************************/
+static uint8_t* jfs_mmap_base;
+static size_t   jfs_mmap_size;
+
+static int jfs_mmap_read(int fd, uint64_t offset, uint8_t* buf, int size) {
+    memcpy(buf, jfs_mmap_base + offset, size);
+    jfs_file_stat.read_cnt  += size / JFS_IO_SZ();
+    return 0;
+}
+
+static int jfs_mmap_write(int fd, uint64_t offset, uint8_t* buf, int size) {
+    memcpy(jfs_mmap_base + offset, buf, size);
+    jfs_file_stat.write_cnt += size / JFS_IO_SZ();
+    return 0;
+}
+
+static uint8_t* jfs_mmap_map(int fd, uint64_t size) {
+    void* base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (base == MAP_FAILED) {
+        return NULL;
+    }
+    jfs_mmap_base = (uint8_t*)base;
+    jfs_mmap_size = size;
+    return jfs_mmap_base;
+}
+
+static int jfs_mmap_sync(int fd) {
+    return msync(jfs_mmap_base, jfs_mmap_size, MS_SYNC) == 0 ? 0 : -errno;
+}
+
+static int jfs_mmap_close(int fd) {
+    if (jfs_mmap_base != NULL) {
+        munmap(jfs_mmap_base, jfs_mmap_size);
+        jfs_mmap_base = NULL;
+    }
+    return close(fd);
+}
+
+static const struct juzfs_backend jfs_mmap_backend = {
+    .name       = "mmap",
+    .open       = jfs_file_open,
+    .close      = jfs_mmap_close,
+    .read       = jfs_mmap_read,
+    .write      = jfs_mmap_write,
+    .disk_size  = jfs_file_disk_size,
+    .io_size    = jfs_file_io_size,
+    .state      = jfs_file_state,
+    .map        = jfs_mmap_map,
+    .sync       = jfs_mmap_sync,
+};
+
+/******************************************************************************
+* SECTION: 后端选择
+*******************************************************************************/
+static const struct juzfs_backend* jfs_backends[] = {
+#ifdef JFS_HAVE_DDRIVER
+    &jfs_ddriver_backend,
+#endif
+    &jfs_file_backend,
+    &jfs_mmap_backend,
+#ifdef JFS_HAVE_IO_URING
+    &jfs_uring_backend,
+#endif
+};
+
+/**
+ * @brief 按名字选择存储后端
+ *
+ * @param name ddriver / file / uring / mmap，为NULL时取第一个可用后端
+ * @return const struct juzfs_backend* 未编译该后端时返回NULL，
+ *         其中未编译 io_uring 时 uring 退化为同步的 file 后端
+ */
+const struct juzfs_backend* jfs_backend_select(const char* name) {
+    size_t i;
+
+    if (name == NULL) {
+        return jfs_backends[0];
+    }
+#ifndef JFS_HAVE_IO_URING
+    if (strcmp(name, "uring") == 0) {
+        name = "file";
+    }
+#endif
+    for (i = 0; i < sizeof(jfs_backends) / sizeof(jfs_backends[0]); i++) {
+        if (strcmp(jfs_backends[i]->name, name) == 0) {
+            return jfs_backends[i];
+        }
+    }
+    return NULL;
+}
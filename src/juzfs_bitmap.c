@@ -0,0 +1,427 @@
+#include "types.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+void* jfs_calloc(size_t, size_t);
+
+/******************************************************************************
+* SECTION: 位图操作
+* 位序与磁盘格式一致：第 i 位为 map[i / 8] 的第 i % 8 位（低位在前），
+* 小端机器上按64位字读取时恰好是字内第 i % 64 位。
+*******************************************************************************/
+static inline uint64_t jfs_bitmap_word(const uint8_t* map, int word) {
+    uint64_t w;
+
+    memcpy(&w, map + word * sizeof(uint64_t), sizeof(uint64_t));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    w = __builtin_bswap64(w);
+#endif
+    return w;
+}
+
+/**
+ * @brief 从第 word 个字起跳过全满的字，返回第一个含空闲位的字，没有时返回 end
+ */
+static int jfs_bitmap_skip_full(const uint8_t* map, int word, int end) {
+#ifdef __SSE2__
+    const __m128i ones = _mm_set1_epi8((char)0xFF);
+
+    while (word + 2 <= end) {                       /* 每次比较16字节 */
+        __m128i v = _mm_loadu_si128((const __m128i*)(map + word * sizeof(uint64_t)));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, ones)) != 0xFFFF) {
+            break;
+        }
+        word += 2;
+    }
+#endif
+    while (word < end && jfs_bitmap_word(map, word) == UINT64_MAX) {
+        word++;
+    }
+    return word;
+}
+
+/**
+ * @brief 在 [from, to) 内找第一个空闲位
+ *
+ * @return int 位号，没有时返回 -1
+ */
+static int jfs_bitmap_scan(const uint8_t* map, int from, int to) {
+    int      word = from / 64;
+    int      end  = (to + 63) / 64;
+    uint64_t w;
+    int      bit;
+
+    if (from >= to) {
+        return -1;
+    }
+
+    w = ~jfs_bitmap_word(map, word) & (UINT64_MAX << (from % 64));
+    while (w == 0) {
+        word = jfs_bitmap_skip_full(map, word + 1, end);
+        if (word >= end) {
+            return -1;
+        }
+        w = ~jfs_bitmap_word(map, word);
+    }
+
+    bit = word * 64 + __builtin_ctzll(w);
+    return bit < to ? bit : -1;
+}
+
+/**
+ * @brief next-fit 查找空闲位：从 hint 向后找，到尾部后回绕到开头
+ *
+ * @param map 位图，长度须为8字节的整数倍
+ * @param nbits 有效位数
+ * @param hint 起始位置
+ * @return int 空闲位号，位图已满时返回 -1
+ */
+int jfs_bitmap_find_zero(const uint8_t* map, int nbits, int hint) {
+    int bit;
+
+    if (hint < 0 || hint >= nbits) {
+        hint = 0;
+    }
+    bit = jfs_bitmap_scan(map, hint, nbits);
+    if (bit < 0) {
+        bit = jfs_bitmap_scan(map, 0, hint);
+    }
+    return bit;
+}
+
+/**
+ * @brief 统计 [0, nbits) 内已置位的个数；支持 SSSE3 时用 pshufb 半字节查表，每次16字节
+ */
+int jfs_bitmap_count(const uint8_t* map, int nbits) {
+    int count = 0;
+    int word  = 0;
+
+#ifdef __SSSE3__
+    const __m128i lut  = _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m128i low  = _mm_set1_epi8(0x0F);
+    __m128i       acc  = _mm_setzero_si128();
+    __m128i       v, cnt;
+
+    for (; word + 2 <= nbits / 64; word += 2) {
+        v   = _mm_loadu_si128((const __m128i*)(map + word * sizeof(uint64_t)));
+        cnt = _mm_add_epi8(_mm_shuffle_epi8(lut, _mm_and_si128(v, low)),
+                           _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(v, 4), low)));
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(cnt, _mm_setzero_si128()));
+    }
+    count = _mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(acc, acc));
+#endif
+    for (; word < nbits / 64; word++) {
+        count += __builtin_popcountll(jfs_bitmap_word(map, word));
+    }
+    if (nbits % 64 != 0) {
+        count += __builtin_popcountll(jfs_bitmap_word(map, word) & ((1ULL << (nbits % 64)) - 1));
+    }
+    return count;
+}
+
+void jfs_bitmap_set(uint8_t* map, int bit) {
+    map[bit / UINT8_BITS] |= (uint8_t)(0x1 << (bit % UINT8_BITS));
+}
+
+void jfs_bitmap_clear(uint8_t* map, int bit) {
+    map[bit / UINT8_BITS] &= (uint8_t)(~(0x1 << (bit % UINT8_BITS)));
+}
+
+bool jfs_bitmap_test(const uint8_t* map, int bit) {
+    return (map[bit / UINT8_BITS] >> (bit % UINT8_BITS)) & 0x1;
+}
+
+/******************************************************************************
+* SECTION: 带摘要的分配位图
+* 摘要每位对应位图的一个64位字，置位表示该字仍有空闲位；
+* 分配时先在摘要中用 ctz 找到有空闲的字，空间已满由 nfree 直接判定。
+* 另按段（通常是一个块）记录改过的位置，写回时只写脏段。
+*******************************************************************************/
+static inline uint64_t jfs_bitmap_used(const struct juzfs_bitmap* bm, int word) {
+    uint64_t w = jfs_bitmap_word(bm->map, word);
+
+    if (word == bm->nwords - 1 && bm->nbits % 64 != 0) {
+        w |= UINT64_MAX << (bm->nbits % 64);        /* 超出 nbits 的位视为已用 */
+    }
+    return w;
+}
+
+static inline void jfs_bitmap_touch(struct juzfs_bitmap* bm, int bit) {
+    int chunk = bit / bm->chunk_bits;
+
+    bm->dirty[chunk / 64] |= 1ULL << (chunk % 64);
+}
+
+static inline void jfs_summary_update(struct juzfs_bitmap* bm, int word) {
+    if (jfs_bitmap_used(bm, word) == UINT64_MAX) {
+        bm->summary[word / 64] &= ~(1ULL << (word % 64));
+    } else {
+        bm->summary[word / 64] |= 1ULL << (word % 64);
+    }
+}
+
+/**
+ * @brief 摘要中 [from, nwords) 内第一个有空闲位的字
+ *
+ * @return int 字号，没有时返回 -1
+ */
+static int jfs_summary_next(const struct juzfs_bitmap* bm, int from) {
+    int      sw = from / 64;
+    uint64_t s;
+
+    if (from >= bm->nwords) {
+        return -1;
+    }
+    s = bm->summary[sw] & (UINT64_MAX << (from % 64));
+    while (s == 0) {
+        if (++sw >= (bm->nwords + 63) / 64) {
+            return -1;
+        }
+        s = bm->summary[sw];
+    }
+    return sw * 64 + __builtin_ctzll(s);
+}
+
+/**
+ * @brief 建立位图的摘要、脏段标记与空闲计数
+ *
+ * @param bm
+ * @param map 磁盘位图，长度须为8字节的整数倍，且不短于 chunk 的整数倍
+ * @param nbits 有效位数
+ * @param nfree 已知的空闲位数，小于0时用 popcount 重新统计
+ * @param chunk 脏段的字节数，须为8的倍数
+ * @return int
+ */
+int jfs_bitmap_init(struct juzfs_bitmap* bm, uint8_t* map, int nbits, int nfree, int chunk) {
+    int word;
+
+    bm->map        = map;
+    bm->nbits      = nbits;
+    bm->nwords     = (nbits + 63) / 64;
+    bm->cursor     = 0;
+    bm->chunk_bits = chunk * UINT8_BITS;
+    bm->nchunks    = (nbits + bm->chunk_bits - 1) / bm->chunk_bits;
+    bm->summary    = (uint64_t*)jfs_calloc((bm->nwords + 63) / 64, sizeof(uint64_t));
+    bm->dirty      = (uint64_t*)jfs_calloc((bm->nchunks + 63) / 64, sizeof(uint64_t));
+    if (bm->summary == NULL || bm->dirty == NULL) {
+        free(bm->summary);
+        free(bm->dirty);
+        return -ENOMEM;
+    }
+    for (word = 0; word < bm->nwords; word++) {
+        jfs_summary_update(bm, word);
+    }
+    bm->nfree = nfree >= 0 ? nfree : nbits - jfs_bitmap_count(map, nbits);
+    return 0;
+}
+
+void jfs_bitmap_destroy(struct juzfs_bitmap* bm) {
+    free(bm->summary);
+    free(bm->dirty);
+    bm->summary = NULL;
+    bm->dirty   = NULL;
+}
+
+/**
+ * @brief 从第 from 段起找第一组连续的脏段，不清除标记
+ *
+ * @param bm
+ * @param from 段号
+ * @param cnt 输出，连续的脏段数
+ * @return int 首段号，没有时返回 -1
+ */
+int jfs_bitmap_next_dirty(const struct juzfs_bitmap* bm, int from, int* cnt) {
+    int      start, end;
+    uint64_t d;
+
+    for (start = from; start < bm->nchunks; start = (start / 64 + 1) * 64) {
+        d = bm->dirty[start / 64] & (UINT64_MAX << (start % 64));
+        if (d != 0) {
+            start = start / 64 * 64 + __builtin_ctzll(d);
+            break;
+        }
+    }
+    if (start >= bm->nchunks) {
+        return -1;
+    }
+    for (end = start + 1; end < bm->nchunks && (bm->dirty[end / 64] >> (end % 64)) & 0x1; end++)
+        ;
+    *cnt = end - start;
+    return start;
+}
+
+/**
+ * @brief 脏段已全部写回，清除标记
+ */
+void jfs_bitmap_clean(struct juzfs_bitmap* bm) {
+    memset(bm->dirty, 0, sizeof(uint64_t) * ((bm->nchunks + 63) / 64));
+}
+
+/**
+ * @brief next-fit 分配一个空闲位：先查游标所在字，再经摘要跳到下一个有空闲的字，到尾部后回绕
+ *
+ * @return int 位号，已满时返回 -1
+ */
+int jfs_bitmap_alloc(struct juzfs_bitmap* bm) {
+    int      word, bit;
+    uint64_t w;
+
+    if (bm->nfree == 0) {
+        return -1;
+    }
+    if (bm->cursor >= bm->nbits) {
+        bm->cursor = 0;
+    }
+
+    word = bm->cursor / 64;
+    w    = ~jfs_bitmap_used(bm, word) & (UINT64_MAX << (bm->cursor % 64));
+    if (w == 0) {
+        word = jfs_summary_next(bm, word + 1);
+        if (word < 0) {
+            word = jfs_summary_next(bm, 0);
+        }
+        if (word < 0) {                              /* 计数与位图不一致 */
+            return -1;
+        }
+        w = ~jfs_bitmap_used(bm, word);
+    }
+
+    bit = word * 64 + __builtin_ctzll(w);
+    jfs_bitmap_set(bm->map, bit);
+    jfs_bitmap_touch(bm, bit);
+    jfs_summary_update(bm, word);
+    bm->nfree--;
+    bm->cursor = bit + 1;
+    return bit;
+}
+
+/**
+ * @brief 释放一个位，游标指向它以便下次分配直接复用
+ */
+void jfs_bitmap_free(struct juzfs_bitmap* bm, int bit) {
+    if (!jfs_bitmap_test(bm->map, bit)) {
+        return;
+    }
+    jfs_bitmap_clear(bm->map, bit);
+    jfs_bitmap_touch(bm, bit);
+    bm->summary[bit / 64 / 64] |= 1ULL << (bit / 64 % 64);
+    bm->nfree++;
+    bm->cursor = bit;
+}
+
+/**
+ * @brief [pos, nbits) 内第一个空闲位，经摘要跳过全满的字
+ *
+ * @return int 位号，没有时返回 -1
+ */
+static int jfs_bitmap_next_free(const struct juzfs_bitmap* bm, int pos) {
+    int      word;
+    uint64_t w;
+
+    if (pos >= bm->nbits) {
+        return -1;
+    }
+    word = pos / 64;
+    w    = ~jfs_bitmap_used(bm, word) & (UINT64_MAX << (pos % 64));
+    if (w == 0) {
+        word = jfs_summary_next(bm, word + 1);
+        if (word < 0) {
+            return -1;
+        }
+        w = ~jfs_bitmap_used(bm, word);
+    }
+    return word * 64 + __builtin_ctzll(w);
+}
+
+/**
+ * @brief 从空闲位 from 起的连续空闲长度，最多数到 limit
+ */
+static int jfs_bitmap_run_len(const struct juzfs_bitmap* bm, int from, int limit) {
+    int      len = 0;
+    int      off, avail, n;
+    uint64_t w;
+
+    while (len < limit) {
+        off   = (from + len) % 64;
+        avail = 64 - off;
+        w     = jfs_bitmap_used(bm, (from + len) / 64) >> off;
+        n     = w == 0 ? avail : __builtin_ctzll(w);
+        len  += n;
+        if (n < avail || from + len >= bm->nbits) {
+            break;
+        }
+    }
+    return len < limit ? len : limit;
+}
+
+/**
+ * @brief 分配连续的一段：从 goal 起（回绕一次）找长度不小于 want 的空闲段，
+ * 找不到时退而分配途中遇到的最长空闲段
+ *
+ * @param bm
+ * @param goal 期望的起点（如文件最后一块之后），小于0时取 next-fit 游标
+ * @param want 期望长度
+ * @param got 输出，实际分配的长度
+ * @return int 起始位号，已满时返回 -1
+ */
+int jfs_bitmap_alloc_run(struct juzfs_bitmap* bm, int goal, int want, int* got) {
+    int  best_start = -1;
+    int  best_len   = 0;
+    int  pos, start, len, bit;
+    bool wrapped    = false;
+
+    *got = 0;
+    if (bm->nfree == 0 || want <= 0) {
+        return -1;
+    }
+    if (goal < 0 || goal >= bm->nbits) {
+        goal = bm->cursor < bm->nbits ? bm->cursor : 0;
+    }
+
+    for (pos = goal; ; pos = start + len) {
+        start = jfs_bitmap_next_free(bm, pos);
+        if (start < 0 || (wrapped && start >= goal)) {
+            if (wrapped || goal == 0) {
+                break;
+            }
+            wrapped = true;                          /* 回绕到开头再找一遍 */
+            start   = 0;
+            len     = 0;
+            continue;
+        }
+        len = jfs_bitmap_run_len(bm, start, want);
+        if (len > best_len) {
+            best_start = start;
+            best_len   = len;
+        }
+        if (len >= want) {
+            break;
+        }
+    }
+
+    if (best_len == 0) {                             /* 计数与位图不一致 */
+        return -1;
+    }
+    for (bit = best_start; bit < best_start + best_len; bit++) {
+        jfs_bitmap_set(bm->map, bit);
+    }
+    for (bit = best_start; bit < best_start + best_len; bit += bm->chunk_bits) {
+        jfs_bitmap_touch(bm, bit);
+    }
+    jfs_bitmap_touch(bm, best_start + best_len - 1);
+    for (bit = best_start / 64; bit <= (best_start + best_len - 1) / 64; bit++) {
+        jfs_summary_update(bm, bit);
+    }
+    bm->nfree  -= best_len;
+    bm->cursor  = best_start + best_len;
+    *got        = best_len;
+    return best_start;
+}
@@ -0,0 +1,560 @@
+#include "juzfs.h"
+#include "types.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+extern struct juzfs_super super;
+
+static struct juzfs_cache cache;
+
+/******************************************************************************
+* SECTION: 内部工具
+*******************************************************************************/
+static inline int jfs_cache_hash(uint64_t blkno) {
+    return (int)((blkno * 0x9E3779B97F4A7C15ULL) >> 32) & (cache.nbuckets - 1);
+}
+
+static inline void jfs_lru_unlink(struct juzfs_buf* buf) {
+    buf->lru_prev->lru_next = buf->lru_next;
+    buf->lru_next->lru_prev = buf->lru_prev;
+}
+
+static inline void jfs_lru_push_front(struct juzfs_buf* buf) {
+    buf->lru_next               = cache.lru.lru_next;
+    buf->lru_prev               = &cache.lru;
+    cache.lru.lru_next->lru_prev = buf;
+    cache.lru.lru_next          = buf;
+}
+
+static struct juzfs_buf* jfs_cache_find(uint64_t blkno) {
+    struct juzfs_buf* buf = cache.buckets[jfs_cache_hash(blkno)];
+    while (buf != NULL && buf->blkno != blkno) {
+        buf = buf->hash_next;
+    }
+    return buf;
+}
+
+static void jfs_cache_unhash(struct juzfs_buf* buf) {
+    struct juzfs_buf** cursor = &cache.buckets[jfs_cache_hash(buf->blkno)];
+    while (*cursor != buf) {
+        cursor = &(*cursor)->hash_next;
+    }
+    *cursor = buf->hash_next;
+}
+
+static int jfs_cache_writeback(struct juzfs_buf* buf) {
+    if (jfs_dev_write(JFS_BLKS_SZ(buf->blkno), buf->data, JFS_BLK_SZ()) != 0) {
+        return -EIO;
+    }
+    buf->flags &= ~JFS_BUF_DIRTY;
+    cache.ndirty--;
+    cache.stats.writeback++;
+    return 0;
+}
+
+/**
+ * @brief 取得一个空闲缓冲区，满时淘汰LRU尾部，脏块先回写
+ *
+ * @return struct juzfs_buf*
+ */
+static struct juzfs_buf* jfs_cache_victim(void) {
+    struct juzfs_buf* buf;
+
+    if (cache.free != NULL) {
+        buf        = cache.free;
+        cache.free = buf->hash_next;
+        return buf;
+    }
+
+    buf = cache.lru.lru_prev;
+    if (buf->flags & JFS_BUF_DIRTY) {
+        if (jfs_cache_writeback(buf) != 0) {
+            return NULL;
+        }
+    }
+    jfs_lru_unlink(buf);
+    jfs_cache_unhash(buf);
+    cache.stats.evict++;
+    return buf;
+}
+
+static int jfs_cmp_buf(const void* a, const void* b) {
+    uint64_t x = (*(struct juzfs_buf**)a)->blkno;
+    uint64_t y = (*(struct juzfs_buf**)b)->blkno;
+    return x < y ? -1 : (x > y);
+}
+
+/******************************************************************************
+* SECTION: 接口
+*******************************************************************************/
+/**
+ * @brief 初始化块缓存
+ *
+ * @param size 内存预算（字节），不足一个块时关闭缓存
+ * @return int
+ */
+int jfs_cache_init(int size) {
+    int i;
+
+    memset(&cache, 0, sizeof(struct juzfs_cache));
+    cache.lru.lru_next = &cache.lru;
+    cache.lru.lru_prev = &cache.lru;
+    cache.nbufs        = size / JFS_BLK_SZ();
+
+    if (cache.nbufs <= 0) {
+        cache.nbufs = 0;
+        return 0;
+    }
+
+    cache.nbuckets = 1;
+    while (cache.nbuckets < cache.nbufs) {
+        cache.nbuckets <<= 1;
+    }
+
+    cache.bufs    = (struct juzfs_buf*)jfs_calloc(cache.nbufs, sizeof(struct juzfs_buf));
+    cache.slab    = (uint8_t*)jfs_malloc(JFS_BLKS_SZ((size_t)cache.nbufs));
+    cache.buckets = (struct juzfs_buf**)jfs_calloc(cache.nbuckets, sizeof(struct juzfs_buf*));
+    cache.ra_max     = cache.nbufs / 2 < JFS_RA_MAX_BLKS ? cache.nbufs / 2 : JFS_RA_MAX_BLKS;
+    cache.ra_io      = (struct juzfs_io*)jfs_malloc(sizeof(struct juzfs_io) * (cache.ra_max + 1));
+    cache.ra_staging = (uint8_t*)jfs_malloc(JFS_BLKS_SZ((size_t)cache.ra_max + 1));
+    if (cache.bufs == NULL || cache.slab == NULL || cache.buckets == NULL ||
+        cache.ra_io == NULL || cache.ra_staging == NULL) {
+        jfs_cache_destroy();
+        return -ENOMEM;
+    }
+
+    for (i = 0; i < cache.nbufs; i++) {
+        cache.bufs[i].data      = cache.slab + JFS_BLKS_SZ((size_t)i);
+        cache.bufs[i].hash_next = cache.free;
+        cache.free              = &cache.bufs[i];
+    }
+    return 0;
+}
+
+bool jfs_cache_enabled(void) {
+    return cache.nbufs > 0;
+}
+
+/**
+ * @brief 从设备填充缓冲区中未被 [bias, bias + length) 完整覆盖的IO单位
+ *
+ * @param buf
+ * @param bias 将被覆盖写的块内偏移
+ * @param length 将被覆盖写的长度，为0时整块读入
+ * @return int
+ */
+static int jfs_cache_fill(struct juzfs_buf* buf, int bias, int length) {
+    int unit;
+    int run_start = -1;
+    int units     = JFS_BLK_SZ() / JFS_IO_SZ();
+
+    for (unit = 0; unit <= units; unit++) {
+        bool covered = unit == units ||
+                       (bias <= unit * JFS_IO_SZ() && (unit + 1) * JFS_IO_SZ() <= bias + length);
+        if (!covered && run_start < 0) {
+            run_start = unit;
+        }
+        if (covered && run_start >= 0) {            /* 连续的部分覆盖单位一次读入 */
+            if (jfs_dev_read(JFS_BLKS_SZ(buf->blkno) + run_start * JFS_IO_SZ(),
+                             buf->data + run_start * JFS_IO_SZ(),
+                             (unit - run_start) * JFS_IO_SZ()) != 0) {
+                return -EIO;
+            }
+            run_start = -1;
+        }
+    }
+    return 0;
+}
+
+static void jfs_cache_install(struct juzfs_buf* buf) {
+    buf->hash_next = cache.buckets[jfs_cache_hash(buf->blkno)];
+    cache.buckets[jfs_cache_hash(buf->blkno)] = buf;
+    jfs_lru_push_front(buf);
+}
+
+/**
+ * @brief 收割已提交的预读并装入缓存，其它缓存操作之前调用，
+ * 保证设备上的预读与缓存内容不会交错
+ */
+static void jfs_cache_ra_complete(void) {
+    struct juzfs_buf* buf;
+    uint64_t          blkno;
+    int               i, j;
+
+    if (cache.ra_iocnt == 0) {
+        return;
+    }
+    if (jfs_dev_wait() != 0) {                    /* 预读失败只是放弃，不影响正常读 */
+        cache.ra_iocnt = 0;
+        return;
+    }
+
+    for (i = 0; i < cache.ra_iocnt; i++) {
+        for (j = 0; j < cache.ra_io[i].size / JFS_BLK_SZ(); j++) {
+            blkno = cache.ra_io[i].offset / JFS_BLK_SZ() + j;
+            if (jfs_cache_find(blkno) != NULL) {
+                continue;
+            }
+            buf = jfs_cache_victim();
+            if (buf == NULL) {
+                break;
+            }
+            buf->blkno = blkno;
+            buf->flags = JFS_BUF_READAHEAD;
+            memcpy(buf->data, cache.ra_io[i].buf + JFS_BLKS_SZ(j), JFS_BLK_SZ());
+            jfs_cache_install(buf);
+            cache.stats.ra_issued++;
+        }
+    }
+    cache.ra_iocnt = 0;
+}
+
+static struct juzfs_buf* jfs_cache_lookup(uint64_t blkno, int bias, int length) {
+    struct juzfs_buf* buf;
+
+    jfs_cache_ra_complete();
+    buf = jfs_cache_find(blkno);
+    if (buf != NULL) {
+        cache.stats.hit++;
+        if (buf->flags & JFS_BUF_READAHEAD) {
+            cache.stats.ra_hit++;
+            buf->flags &= ~JFS_BUF_READAHEAD;
+        }
+        jfs_lru_unlink(buf);
+        jfs_lru_push_front(buf);
+        return buf;
+    }
+
+    cache.stats.miss++;
+    buf = jfs_cache_victim();
+    if (buf == NULL) {
+        return NULL;
+    }
+
+    buf->blkno = blkno;
+    buf->flags = 0;
+    if (jfs_cache_fill(buf, bias, length) != 0) {
+        buf->hash_next = cache.free;        /* 放回空闲链表 */
+        cache.free     = buf;
+        return NULL;
+    }
+
+    jfs_cache_install(buf);
+    return buf;
+}
+
+/**
+ * @brief 获取设备块对应的缓冲区，未命中时从设备读入
+ *
+ * @param blkno 设备块号
+ * @return struct juzfs_buf* NULL表示IO失败
+ */
+struct juzfs_buf* jfs_cache_get(uint64_t blkno) {
+    return jfs_cache_lookup(blkno, 0, 0);
+}
+
+/**
+ * @brief 获取将被写入 [bias, bias + length) 的缓冲区，未命中时只读入不被完整覆盖的IO单位
+ *
+ * @param blkno 设备块号
+ * @param bias 块内偏移
+ * @param length 写入长度
+ * @return struct juzfs_buf* NULL表示IO失败
+ */
+struct juzfs_buf* jfs_cache_get_for_write(uint64_t blkno, int bias, int length) {
+    return jfs_cache_lookup(blkno, bias, length);
+}
+
+/**
+ * @brief 预读 [blkno, blkno + blks) 到缓存，相邻的未命中块合并为一次设备传输，
+ * 各段作为一批提交，整批完成后装入缓存
+ *
+ * @param blkno 起始设备块号
+ * @param blks 块数，超过缓存容量的部分不预读
+ * @return int
+ */
+int jfs_cache_prefetch(uint64_t blkno, int blks) {
+    struct juzfs_arena_mark mark = jfs_scratch_mark();
+    struct juzfs_io*  io;
+    struct juzfs_buf* buf;
+    uint8_t*          staging;
+    uint64_t          cursor;
+    int               iocnt   = 0;
+    int               missing = 0;
+    int               ret     = 0;
+    int               i, j;
+
+    jfs_cache_ra_complete();
+    if (blks > cache.nbufs) {
+        blks = cache.nbufs;
+    }
+    io      = (struct juzfs_io*)jfs_scratch_alloc(sizeof(struct juzfs_io) * (blks / 2 + 1));
+    staging = (uint8_t*)jfs_scratch_alloc(JFS_BLKS_SZ((size_t)blks));
+
+    for (cursor = blkno; cursor < blkno + blks; ) {
+        if (jfs_cache_find(cursor) != NULL) {
+            cursor++;
+            continue;
+        }
+        io[iocnt].offset   = JFS_BLKS_SZ(cursor);
+        io[iocnt].buf      = staging + JFS_BLKS_SZ(missing);
+        io[iocnt].is_write = false;
+        while (cursor < blkno + blks && jfs_cache_find(cursor) == NULL) {
+            cursor++;
+            missing++;
+        }
+        io[iocnt].size     = staging + JFS_BLKS_SZ(missing) - io[iocnt].buf;
+        iocnt++;
+    }
+
+    if (iocnt > 0 && (jfs_dev_submit(io, iocnt) != 0 || jfs_dev_wait() != 0)) {
+        ret = -EIO;
+    }
+
+    for (i = 0; i < iocnt && ret == 0; i++) {
+        for (j = 0; j < io[i].size / JFS_BLK_SZ(); j++) {
+            cache.stats.miss++;
+            buf = jfs_cache_victim();
+            if (buf == NULL) {
+                ret = -EIO;
+                break;
+            }
+            buf->blkno = io[i].offset / JFS_BLK_SZ() + j;
+            buf->flags = 0;
+            memcpy(buf->data, io[i].buf + JFS_BLKS_SZ(j), JFS_BLK_SZ());
+            jfs_cache_install(buf);
+        }
+    }
+    jfs_scratch_release(mark);
+    return ret;
+}
+
+/**
+ * @brief 标脏并记下时刻；脏块数达到 dirty_limit 时唤醒后台回写，不在此同步写出
+ *
+ * @param buf
+ */
+void jfs_cache_mark_dirty(struct juzfs_buf* buf) {
+    if (buf->flags & JFS_BUF_DIRTY) {
+        return;
+    }
+    buf->flags     |= JFS_BUF_DIRTY;
+    buf->dirtied_at = jfs_now_ms();
+    if (++cache.ndirty == cache.dirty_limit) {
+        jfs_wb_kick();
+    }
+}
+
+/**
+ * @brief 设置唤醒后台回写的脏块比例
+ *
+ * @param ratio 百分比，0表示只按时间回写
+ */
+void jfs_cache_set_dirty_ratio(int ratio) {
+    cache.dirty_limit = ratio <= 0 ? 0 : cache.nbufs * ratio / 100;
+    if (ratio > 0 && cache.dirty_limit == 0) {
+        cache.dirty_limit = 1;
+    }
+}
+
+bool jfs_cache_over_dirty_limit(void) {
+    return cache.dirty_limit > 0 && cache.ndirty >= cache.dirty_limit;
+}
+
+static bool jfs_cache_pick_all(const struct juzfs_buf* buf, const void* arg) {
+    return true;
+}
+
+static bool jfs_cache_pick_expired(const struct juzfs_buf* buf, const void* arg) {
+    const uint64_t* t = (const uint64_t*)arg;                /* before, since */
+    return buf->dirtied_at <= t[0] || buf->dirtied_at >= t[1];
+}
+
+struct jfs_cache_ranges {
+    const struct juzfs_range* ranges;
+    int                       cnt;
+};
+
+static bool jfs_cache_pick_ranges(const struct juzfs_buf* buf, const void* arg) {
+    const struct jfs_cache_ranges* r = (const struct jfs_cache_ranges*)arg;
+    int lo = 0, hi = r->cnt - 1, mid;
+
+    while (lo <= hi) {                              /* 最后一个起点不大于块号的区间 */
+        mid = (lo + hi) / 2;
+        if (r->ranges[mid].start <= buf->blkno) {
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return hi >= 0 && buf->blkno - r->ranges[hi].start < r->ranges[hi].len;
+}
+
+/**
+ * @brief 按块号顺序回写 pick 选中的脏块，相邻脏块合并为一次设备传输，各段作为一批提交
+ *
+ * @return int
+ */
+static int jfs_cache_flush_if(bool (*pick)(const struct juzfs_buf*, const void*), const void* arg) {
+    struct juzfs_arena_mark mark;
+    struct juzfs_buf** dirty;
+    struct juzfs_io*   io;
+    uint8_t*           staging;
+    int                ndirty = 0;
+    int                iocnt  = 0;
+    int                ret    = 0;
+    int                i, j, k;
+
+    if (!jfs_cache_enabled()) {
+        return 0;
+    }
+
+    jfs_cache_ra_complete();
+    if (cache.ndirty == 0) {
+        return 0;
+    }
+    mark  = jfs_scratch_mark();
+    dirty = (struct juzfs_buf**)jfs_scratch_alloc(sizeof(struct juzfs_buf*) * cache.nbufs);
+    for (i = 0; i < cache.nbufs; i++) {
+        if ((cache.bufs[i].flags & JFS_BUF_DIRTY) && pick(&cache.bufs[i], arg)) {
+            dirty[ndirty++] = &cache.bufs[i];
+        }
+    }
+    qsort(dirty, ndirty, sizeof(struct juzfs_buf*), jfs_cmp_buf);
+    staging = (uint8_t*)jfs_scratch_alloc(JFS_BLKS_SZ((size_t)ndirty));
+    io      = (struct juzfs_io*)jfs_scratch_alloc(sizeof(struct juzfs_io) * (ndirty + 1));
+
+    for (i = 0; i < ndirty; i = j) {
+        for (j = i + 1; j < ndirty && dirty[j]->blkno == dirty[j - 1]->blkno + 1; j++);
+
+        io[iocnt].offset   = JFS_BLKS_SZ(dirty[i]->blkno);
+        io[iocnt].size     = JFS_BLKS_SZ(j - i);
+        io[iocnt].is_write = true;
+        if (j - i == 1) {
+            io[iocnt].buf  = dirty[i]->data;
+        } else {
+            io[iocnt].buf  = staging + JFS_BLKS_SZ(i);
+            for (k = i; k < j; k++) {
+                memcpy(staging + JFS_BLKS_SZ(k), dirty[k]->data, JFS_BLK_SZ());
+            }
+        }
+        iocnt++;
+    }
+
+    if (iocnt > 0 && (jfs_dev_submit(io, iocnt) != 0 || jfs_dev_wait() != 0)) {
+        ret = -EIO;
+    }
+    for (i = 0; i < ndirty && ret == 0; i++) {
+        dirty[i]->flags &= ~JFS_BUF_DIRTY;
+        cache.ndirty--;
+        cache.stats.writeback++;
+    }
+    jfs_scratch_release(mark);
+    return ret;
+}
+
+/**
+ * @brief 回写全部脏块
+ *
+ * @return int
+ */
+int jfs_cache_flush(void) {
+    return jfs_cache_flush_if(jfs_cache_pick_all, NULL);
+}
+
+/**
+ * @brief 供后台回写按时间推进：回写在 before 及之前变脏的块，以及 since 及之后变脏的块
+ * （本轮写回inode与位图时刚写入缓存的块）
+ *
+ * @param before jfs_now_ms 的时刻
+ * @param since
+ * @return int
+ */
+int jfs_cache_flush_expired(uint64_t before, uint64_t since) {
+    uint64_t t[2] = { before, since };
+    return jfs_cache_flush_if(jfs_cache_pick_expired, t);
+}
+
+/**
+ * @brief 只回写落在给定区间中的脏块，供 fsync 只写一个inode的块
+ *
+ * @param ranges 按 start 升序且互不重叠
+ * @param cnt
+ * @return int
+ */
+int jfs_cache_flush_ranges(const struct juzfs_range* ranges, int cnt) {
+    struct jfs_cache_ranges r = { ranges, cnt };
+
+    if (cnt == 0) {
+        return 0;
+    }
+    return jfs_cache_flush_if(jfs_cache_pick_ranges, &r);
+}
+
+/**
+ * @brief 异步预读一组设备块（通常是文件中连续的若干块），已缓存的块跳过，
+ * 物理相邻的块合并为一次传输；提交后立即返回，数据在下一次缓存操作时装入
+ *
+ * @param blknos 设备块号
+ * @param cnt 超过 ra_max 的部分不预读
+ * @return int 已处理的块数（含已在缓存中的块），据此推进预读位置
+ */
+int jfs_cache_readahead(const uint64_t* blknos, int cnt) {
+    int issued = 0;
+    int i;
+
+    if (!jfs_cache_enabled()) {
+        return 0;
+    }
+    jfs_cache_ra_complete();
+    if (cnt > cache.ra_max) {
+        cnt = cache.ra_max;
+    }
+
+    for (i = 0; i < cnt; i++) {
+        if (jfs_cache_find(blknos[i]) != NULL) {
+            continue;
+        }
+        if (cache.ra_iocnt > 0 && 
+            cache.ra_io[cache.ra_iocnt - 1].offset + cache.ra_io[cache.ra_iocnt - 1].size 
+                == JFS_BLKS_SZ(blknos[i])) {
+            cache.ra_io[cache.ra_iocnt - 1].size += JFS_BLK_SZ();
+        } else {
+            cache.ra_io[cache.ra_iocnt].offset   = JFS_BLKS_SZ(blknos[i]);
+            cache.ra_io[cache.ra_iocnt].buf      = cache.ra_staging + JFS_BLKS_SZ(issued);
+            cache.ra_io[cache.ra_iocnt].size     = JFS_BLK_SZ();
+            cache.ra_io[cache.ra_iocnt].is_write = false;
+            cache.ra_iocnt++;
+        }
+        issued++;
+    }
+
+    if (cache.ra_iocnt > 0 && jfs_dev_submit(cache.ra_io, cache.ra_iocnt) != 0) {
+        jfs_dev_wait();
+        cache.ra_iocnt = 0;
+        return 0;
+    }
+    return cnt;
+}
+
+void jfs_cache_destroy(void) {
+    jfs_cache_ra_complete();
+    free(cache.ra_io);
+    free(cache.ra_staging);
+    cache.ra_io      = NULL;
+    cache.ra_staging = NULL;
+    free(cache.bufs);
+    free(cache.slab);
+    free(cache.buckets);
+    cache.bufs    = NULL;
+    cache.slab    = NULL;
+    cache.buckets = NULL;
+    cache.free    = NULL;
+    cache.nbufs   = 0;
+}
+
+struct juzfs_cache_stats* jfs_cache_stats(void) {
+    return &cache.stats;
+}
@@ -0,0 +1,242 @@
+#include "juzfs.h"
+#include "types.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+static struct juzfs_dcache dcache;
+
+/******************************************************************************
+* SECTION: 内部工具
+*******************************************************************************/
+static inline int jfs_dcache_bucket(uint32_t hash) {
+    return (int)(hash & (dcache.nbuckets - 1));
+}
+
+static inline void jfs_dcache_lru_unlink(struct juzfs_dcache_ent* ent) {
+    ent->lru_prev->lru_next = ent->lru_next;
+    ent->lru_next->lru_prev = ent->lru_prev;
+}
+
+static inline void jfs_dcache_lru_push_front(struct juzfs_dcache_ent* ent) {
+    ent->lru_next                = dcache.lru.lru_next;
+    ent->lru_prev                = &dcache.lru;
+    dcache.lru.lru_next->lru_prev = ent;
+    dcache.lru.lru_next          = ent;
+}
+
+static struct juzfs_dcache_ent* jfs_dcache_find(const char* path, uint32_t hash) {
+    struct juzfs_dcache_ent* ent = dcache.buckets[jfs_dcache_bucket(hash)];
+
+    while (ent != NULL && (ent->hash != hash || strcmp(ent->path, path) != 0)) {
+        ent = ent->hash_next;
+    }
+    return ent;
+}
+
+/**
+ * @brief 把缓存项从 hash、LRU 与 dentry 链表中摘下并放回空闲链表
+ *
+ * @param ent
+ */
+static void jfs_dcache_release(struct juzfs_dcache_ent* ent) {
+    struct juzfs_dcache_ent** cursor = &dcache.buckets[jfs_dcache_bucket(ent->hash)];
+
+    while (*cursor != ent) {
+        cursor = &(*cursor)->hash_next;
+    }
+    *cursor = ent->hash_next;
+    jfs_dcache_lru_unlink(ent);
+
+    *ent->d_pprev = ent->d_next;
+    if (ent->d_next != NULL) {
+        ent->d_next->d_pprev = ent->d_pprev;
+    }
+
+    ent->path[0]   = '\0';
+    ent->dentry    = NULL;
+    ent->hash_next = dcache.free;
+    dcache.free    = ent;
+}
+
+/******************************************************************************
+* SECTION: 接口
+*******************************************************************************/
+/**
+ * @brief 初始化路径缓存
+ *
+ * @param nents 缓存项数，不大于0时关闭缓存
+ * @return int
+ */
+int jfs_dcache_init(int nents) {
+    int i;
+
+    memset(&dcache, 0, sizeof(struct juzfs_dcache));
+    dcache.lru.lru_next = &dcache.lru;
+    dcache.lru.lru_prev = &dcache.lru;
+    if (nents <= 0) {
+        return 0;
+    }
+
+    dcache.nbuckets = 1;
+    while (dcache.nbuckets < nents) {
+        dcache.nbuckets <<= 1;
+    }
+    dcache.ents    = (struct juzfs_dcache_ent*)jfs_calloc(nents, sizeof(struct juzfs_dcache_ent));
+    dcache.buckets = (struct juzfs_dcache_ent**)jfs_calloc(dcache.nbuckets, sizeof(struct juzfs_dcache_ent*));
+    if (dcache.ents == NULL || dcache.buckets == NULL) {
+        jfs_dcache_destroy();
+        return -ENOMEM;
+    }
+
+    dcache.nents = nents;
+    for (i = 0; i < nents; i++) {
+        dcache.ents[i].hash_next = dcache.free;
+        dcache.free              = &dcache.ents[i];
+    }
+    return 0;
+}
+
+/**
+ * @brief 按完整路径查找
+ *
+ * @param path
+ * @param is_find 命中正项时置 true，命中负项时置 false
+ * @return struct juzfs_dentry* 正项为路径对应的dentry，负项为其父目录的dentry，未命中返回NULL
+ */
+struct juzfs_dentry* jfs_dcache_lookup(const char* path, bool* is_find) {
+    struct juzfs_dcache_ent* ent;
+
+    if (dcache.nents == 0) {
+        return NULL;
+    }
+    ent = jfs_dcache_find(path, jfs_name_hash(path));
+    if (ent == NULL) {
+        dcache.stats.miss++;
+        return NULL;
+    }
+
+    jfs_dcache_lru_unlink(ent);
+    jfs_dcache_lru_push_front(ent);
+    if (ent->negative) {
+        dcache.stats.neg_hit++;
+    } else {
+        dcache.stats.hit++;
+    }
+    *is_find = !ent->negative;
+    return ent->dentry;
+}
+
+/**
+ * @brief 记录一次路径查找的结果，已存在时覆盖；满时淘汰LRU尾部
+ *
+ * @param path
+ * @param dentry 正项为路径对应的dentry，负项为父目录的dentry
+ * @param is_find false 表示负项
+ */
+void jfs_dcache_insert(const char* path, struct juzfs_dentry* dentry, bool is_find) {
+    struct juzfs_dcache_ent* ent;
+    uint32_t                 hash;
+
+    if (dcache.nents == 0 || strlen(path) >= JFS_DCACHE_PATH_LEN) {
+        return;
+    }
+    hash = jfs_name_hash(path);
+    ent  = jfs_dcache_find(path, hash);
+    if (ent != NULL) {
+        jfs_dcache_release(ent);
+    }
+
+    if (dcache.free == NULL) {
+        jfs_dcache_release(dcache.lru.lru_prev);
+        dcache.stats.evict++;
+    }
+    ent         = dcache.free;
+    dcache.free = ent->hash_next;
+
+    strcpy(ent->path, path);
+    ent->hash     = hash;
+    ent->negative = !is_find;
+    ent->dentry   = dentry;
+
+    ent->hash_next = dcache.buckets[jfs_dcache_bucket(hash)];
+    dcache.buckets[jfs_dcache_bucket(hash)] = ent;
+    jfs_dcache_lru_push_front(ent);
+
+    ent->d_next   = dentry->dcache;
+    ent->d_pprev  = &dentry->dcache;
+    if (dentry->dcache != NULL) {
+        dentry->dcache->d_pprev = &ent->d_next;
+    }
+    dentry->dcache = ent;
+}
+
+/**
+ * @brief 使一个路径的缓存项失效，创建文件/目录时清除其负项
+ *
+ * @param path
+ */
+void jfs_dcache_forget_path(const char* path) {
+    struct juzfs_dcache_ent* ent;
+
+    if (dcache.nents == 0) {
+        return;
+    }
+    ent = jfs_dcache_find(path, jfs_name_hash(path));
+    if (ent != NULL) {
+        jfs_dcache_release(ent);
+        dcache.stats.invalidate++;
+    }
+}
+
+/**
+ * @brief dentry 释放前调用：引用它的正项（其路径）与负项（其下不存在的名字）全部失效
+ *
+ * @param dentry
+ */
+void jfs_dcache_forget_dentry(struct juzfs_dentry* dentry) {
+    while (dentry->dcache != NULL) {
+        jfs_dcache_release(dentry->dcache);
+        dcache.stats.invalidate++;
+    }
+}
+
+/**
+ * @brief 目录改名后，其下子孙的 dentry 仍然有效但路径已变，
+ * 使 path 本身及以 path/ 开头的缓存项失效；需要扫描整个缓存，只用于目录改名
+ *
+ * @param path
+ */
+void jfs_dcache_forget_subtree(const char* path) {
+    size_t len = strlen(path);
+    int    i;
+
+    for (i = 0; i < dcache.nents; i++) {
+        if (dcache.ents[i].path[0] != '\0' && strncmp(dcache.ents[i].path, path, len) == 0 &&
+            (dcache.ents[i].path[len] == '\0' || dcache.ents[i].path[len] == '/')) {
+            jfs_dcache_release(&dcache.ents[i]);
+            dcache.stats.invalidate++;
+        }
+    }
+}
+
+void jfs_dcache_destroy(void) {
+    int i;
+
+    for (i = 0; i < dcache.nents; i++) {          /* 卸载时dentry可能仍在，断开它们的链表 */
+        if (dcache.ents[i].path[0] != '\0') {
+            jfs_dcache_release(&dcache.ents[i]);
+        }
+    }
+    free(dcache.ents);
+    free(dcache.buckets);
+    dcache.ents    = NULL;
+    dcache.buckets = NULL;
+    dcache.free    = NULL;
+    dcache.nents   = 0;
+}
+
+struct juzfs_dcache_stats* jfs_dcache_stats(void) {
+    return &dcache.stats;
+}
@@ -31,3 +31,115 @@ void jfs_dump_map(void) {
         printf("\n");
     }
 }
+
+
+void jfs_dump_cache(void) {
+    struct juzfs_cache_stats* stats = jfs_cache_stats();
+    uint64_t total = stats->hit + stats->miss;
+
+    printf("cache: hit=%lu miss=%lu evict=%lu writeback=%lu hit_ratio=%.2f%%\n",
+           stats->hit, stats->miss, stats->evict, stats->writeback,
+           total == 0 ? 0.0 : 100.0 * stats->hit / total);
+    printf("readahead: issued=%lu hit=%lu hit_ratio=%.2f%%\n",
+           stats->ra_issued, stats->ra_hit,
+           stats->ra_issued == 0 ? 0.0 : 100.0 * stats->ra_hit / stats->ra_issued);
+}
+
+void jfs_dump_dcache(void) {
+    struct juzfs_dcache_stats* stats = jfs_dcache_stats();
+    uint64_t total = stats->hit + stats->neg_hit + stats->miss;
+
+    printf("dcache: hit=%lu neg_hit=%lu miss=%lu evict=%lu invalidate=%lu hit_ratio=%.2f%%\n",
+           stats->hit, stats->neg_hit, stats->miss, stats->evict, stats->invalidate,
+           total == 0 ? 0.0 : 100.0 * (stats->hit + stats->neg_hit) / total);
+}
+
+/**
+ * @brief 输出自上次调用以来的设备操作次数（ddriver后端即IOC_REQ_DEVICE_STATE）与堆分配次数，用于回归测试
+ * 
+ * @param phase 阶段名，如 mount / run / umount
+ */
+void jfs_dump_dev_state(const char* phase) {
+    static struct ddriver_state last;
+    static uint64_t             last_allocs;
+    struct ddriver_state        state;
+    uint64_t                    allocs = jfs_heap_allocs();
+
+    JFS_BACKEND()->state(JFS_DRIVER(), &state);
+    if (strcmp(phase, "mount") == 0) {
+        memset(&last, 0, sizeof(struct ddriver_state));
+    }
+    printf("device[%s]: read=%d write=%d seek=%d\n", phase,
+           state.read_cnt - last.read_cnt, state.write_cnt - last.write_cnt,
+           state.seek_cnt - last.seek_cnt);
+    printf("heap[%s]: alloc=%llu\n", phase, (unsigned long long)(allocs - last_allocs));
+    last        = state;
+    last_allocs = allocs;
+}
+
+/**
+ * @brief 统计一个文件的物理段数（相邻数据块号连续视为同一段）
+ */
+static int jfs_count_extents(struct juzfs_inode* inode) {
+    uint64_t blks    = JFS_ROUND_UP(inode->size, JFS_BLK_SZ()) / JFS_BLK_SZ();
+    uint64_t pblk;
+    uint64_t next    = UINT64_MAX;
+    int      extents = 0;
+    int      run;
+
+    for (uint64_t i = 0; i < blks; i += run) {       /* 区段树中相邻的区段也可能物理连续 */
+        run = jfs_extent_map(inode, i, &pblk);
+        if (run <= 0) {
+            break;
+        }
+        if (pblk == JFS_EXT_HOLE) {
+            continue;
+        }
+        pblk = JFS_EXT_PBLK(pblk);
+        if (pblk != next) {
+            extents++;
+        }
+        next = pblk + run;
+    }
+    return extents;
+}
+
+static void jfs_walk_frag(struct juzfs_dentry* dentry, int* files, int* extents, int* worst) {
+    struct juzfs_inode* inode;
+    int                 n;
+
+    if (dentry->inode == NULL) {                     /* 未加载的子树从设备读入 */
+        dentry->inode = jfs_read_inode(dentry, dentry->ino);
+        if (dentry->inode == NULL) {
+            return;
+        }
+    }
+    inode = dentry->inode;
+    if (JFS_IS_DIR(inode)) {
+        jfs_read_dentrys(inode, inode->dir_cnt);
+        for (int i = 0; i < inode->dir_loaded; i++) {
+            if (inode->dentrys[i] != NULL) {
+                jfs_walk_frag(inode->dentrys[i], files, extents, worst);
+            }
+        }
+        return;
+    }
+    if (inode->size == 0 || JFS_IS_INLINE(inode)) {  /* 内联文件不占数据块 */
+        return;
+    }
+    n         = jfs_count_extents(inode);
+    *files   += 1;
+    *extents += n;
+    *worst    = n > *worst ? n : *worst;
+}
+
+/**
+ * @brief 输出碎片化程度：使用数据块的普通文件的平均物理段数，理想值为1
+ */
+void jfs_dump_frag(void) {
+    int files = 0, extents = 0, worst = 0;
+
+    jfs_walk_frag(super.root_dentry, &files, &extents, &worst);
+    printf("frag: files=%d extents=%d extents_per_file=%.2f max=%d\n",
+           files, extents, files == 0 ? 0.0 : (double)extents / files, worst);
+}
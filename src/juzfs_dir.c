@@ -0,0 +1,233 @@
+#include "types.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+void* jfs_calloc(size_t, size_t);
+
+/******************************************************************************
+* SECTION: 目录索引
+* 目录已读入的子项按加入顺序保存在指针数组 dentrys 的前 dir_loaded 个槽中（readdir 的顺序，
+* 也是写回磁盘的顺序），每项带一个单调递增的 cookie；删除只把槽置空，空槽过半时保序压缩，
+* 因此 readdir 按 cookie 续读时，删除与新增都不会使未读到的项被跳过或重复。
+* 另建一张按名字哈希的开放寻址表 dtab，线性探测，装载率不超过1/2；
+* 删除时把后续同簇的项前移（backward shift），不留墓碑。
+* dentry 单独分配、地址不变，inode->dentry 与子项的 parent 始终有效。
+* 平铺目录写回时只重写 dir_dirty 槽之后的部分，由调用者在增删时标记，压缩时随之调整。
+*******************************************************************************/
+#define JFS_DTAB_MIN    16
+#define JFS_DARR_MIN    8
+
+/**
+ * @brief 名字哈希 (FNV-1a)，创建 dentry 时计算并缓存在 dentry->hash
+ *
+ * @param name
+ * @return uint32_t
+ */
+uint32_t jfs_name_hash(const char* name) {
+    uint32_t h = 2166136261u;
+
+    while (*name) {
+        h ^= (uint8_t)*name++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void jfs_dtab_put(struct juzfs_dentry** tab, int size, struct juzfs_dentry* dentry) {
+    int i = dentry->hash & (size - 1);
+
+    while (tab[i] != NULL) {
+        i = (i + 1) & (size - 1);
+    }
+    tab[i] = dentry;
+}
+
+static int jfs_dtab_resize(struct juzfs_inode* dir, int size) {
+    struct juzfs_dentry** tab = (struct juzfs_dentry**)jfs_calloc(size, sizeof(struct juzfs_dentry*));
+
+    if (tab == NULL) {
+        return -ENOMEM;
+    }
+    for (int i = 0; i < dir->dir_loaded; i++) {
+        if (dir->dentrys[i] != NULL) {
+            jfs_dtab_put(tab, size, dir->dentrys[i]);
+        }
+    }
+    free(dir->dtab);
+    dir->dtab      = tab;
+    dir->dtab_size = size;
+    return 0;
+}
+
+/**
+ * @brief 把 dentrys 换成容量为 size 的新数组，同时去掉空槽（保持顺序），
+ * 须重写的起点 dir_dirty 随之前移
+ */
+static int jfs_darr_resize(struct juzfs_inode* dir, int size) {
+    struct juzfs_dentry** arr   = (struct juzfs_dentry**)jfs_malloc(sizeof(struct juzfs_dentry*) * size);
+    int                   cnt   = 0;
+    int                   dirty = JFS_DIR_CLEAN;
+
+    if (arr == NULL) {
+        return -ENOMEM;
+    }
+    for (int i = 0; i < dir->dir_loaded; i++) {
+        if (dir->dentrys[i] != NULL) {
+            if (dirty == JFS_DIR_CLEAN && i >= dir->dir_dirty) {
+                dirty = cnt;
+            }
+            arr[cnt]      = dir->dentrys[i];
+            arr[cnt]->idx = cnt;
+            cnt++;
+        }
+    }
+    free(dir->dentrys);
+    dir->dentrys           = arr;
+    dir->dentrys_list_size = size;
+    dir->dir_loaded        = cnt;
+    dir->dir_holes         = 0;
+    dir->dir_dirty         = dirty != JFS_DIR_CLEAN || dir->dir_dirty == JFS_DIR_CLEAN ? dirty : cnt;
+    return 0;
+}
+
+/**
+ * @brief 释放目录索引本身（不含其中的 dentry）
+ *
+ * @param dir
+ */
+void jfs_dir_free(struct juzfs_inode* dir) {
+    free(dir->dentrys);
+    free(dir->dtab);
+    dir->dentrys           = NULL;
+    dir->dentrys_list_size = 0;
+    dir->dtab              = NULL;
+    dir->dtab_size         = 0;
+    dir->dir_loaded        = 0;
+    dir->dir_holes         = 0;
+    if (dir->dir_dirty != JFS_DIR_CLEAN) {
+        dir->dir_dirty     = 0;
+    }
+}
+
+/**
+ * @brief 在目录中按名字精确查找子项
+ *
+ * @param dir 目录inode
+ * @param name
+ * @return struct juzfs_dentry* 未找到时返回NULL
+ */
+struct juzfs_dentry* jfs_dir_find(struct juzfs_inode* dir, const char* name) {
+    uint32_t hash;
+    int      i;
+
+    if (dir->dtab_size == 0) {
+        return NULL;
+    }
+    hash = jfs_name_hash(name);
+    for (i = hash & (dir->dtab_size - 1); dir->dtab[i] != NULL; i = (i + 1) & (dir->dtab_size - 1)) {
+        if (dir->dtab[i]->hash == hash && strcmp(dir->dtab[i]->name, name) == 0) {
+            return dir->dtab[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief 把子项加入目录：追加到 dentrys 末尾并登记到哈希表，两者都按倍数扩容
+ *
+ * @param dir
+ * @param dentry 由 new_dentry 分配，此后归目录所有
+ * @return int
+ */
+int jfs_dir_add(struct juzfs_inode* dir, struct juzfs_dentry* dentry) {
+    int size;
+
+    if (dir->dir_loaded == dir->dentrys_list_size) {  /* 空槽较多时压缩即可，不必扩容 */
+        size = dir->dentrys_list_size == 0 ? JFS_DARR_MIN :
+               dir->dir_holes * 4 >= dir->dentrys_list_size ? dir->dentrys_list_size : dir->dentrys_list_size * 2;
+        if (jfs_darr_resize(dir, size) != 0) {
+            return -ENOMEM;
+        }
+    }
+    if ((dir->dir_loaded - dir->dir_holes + 1) * 2 > dir->dtab_size) {
+        size = dir->dtab_size == 0 ? JFS_DTAB_MIN : dir->dtab_size * 2;
+        if (jfs_dtab_resize(dir, size) != 0) {
+            return -ENOMEM;
+        }
+    }
+    dentry->idx                   = dir->dir_loaded;
+    dentry->cookie                = ++dir->dir_seq;
+    dir->dentrys[dir->dir_loaded++]  = dentry;
+    jfs_dtab_put(dir->dtab, dir->dtab_size, dentry);
+    return 0;
+}
+
+/**
+ * @brief 从目录中移除子项：哈希表中后续同簇的项前移补位，数组中只把槽置空，
+ * 空槽过半时保序压缩，均摊 O(1)；不释放 dentry 本身
+ *
+ * @param dir
+ * @param dentry
+ */
+void jfs_dir_remove(struct juzfs_inode* dir, struct juzfs_dentry* dentry) {
+    int mask = dir->dtab_size - 1;
+    int i, j, home, live;
+
+    for (i = dentry->hash & mask; dir->dtab[i] != dentry; i = (i + 1) & mask)
+        ;
+    for (j = (i + 1) & mask; dir->dtab[j] != NULL; j = (j + 1) & mask) {
+        home = dir->dtab[j]->hash & mask;
+        if (((j - home) & mask) >= ((j - i) & mask)) { /* j 的起始位置不在 (i, j] 中，可以前移到 i */
+            dir->dtab[i] = dir->dtab[j];
+            i = j;
+        }
+    }
+    dir->dtab[i] = NULL;
+
+    dir->dentrys[dentry->idx] = NULL;
+    dir->dir_holes++;
+    while (dir->dir_loaded > 0 && dir->dentrys[dir->dir_loaded - 1] == NULL) {
+        dir->dir_loaded--;                              /* 末尾不留空槽 */
+        dir->dir_holes--;
+    }
+
+    live = dir->dir_loaded - dir->dir_holes;
+    if (live == 0) {                                    /* 空目录不占内存 */
+        jfs_dir_free(dir);
+        return;
+    }
+    if (live * 8 < dir->dtab_size && dir->dtab_size > JFS_DTAB_MIN) {
+        jfs_dtab_resize(dir, dir->dtab_size / 2);       /* 失败时保留原表，仍然可用 */
+    }
+    if (live * 4 < dir->dentrys_list_size && dir->dentrys_list_size > JFS_DARR_MIN) {
+        jfs_darr_resize(dir, dir->dentrys_list_size / 2);
+    } else if (dir->dir_holes * 2 > dir->dir_loaded) {
+        jfs_darr_resize(dir, dir->dentrys_list_size);
+    }
+}
+
+/**
+ * @brief readdir 续读：找到第一个 cookie 大于给定值的槽
+ *
+ * @param dir
+ * @param cookie 上次返回的最后一项的 cookie，0 表示从头开始
+ * @return int 槽下标，可能是空槽；等于 dir_loaded 表示已读入的部分已读完
+ */
+int jfs_dir_seek(struct juzfs_inode* dir, uint64_t cookie) {
+    int lo = 0, hi = dir->dir_loaded, mid, m;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        for (m = mid; m < hi && dir->dentrys[m] == NULL; m++)
+            ;
+        if (m == hi || dir->dentrys[m]->cookie > cookie) {  /* [mid, m) 都是空槽 */
+            hi = mid;
+        } else {
+            lo = m + 1;
+        }
+    }
+    return lo;
+}
@@ -0,0 +1,602 @@
+#include "juzfs.h"
+#include "types.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+extern struct juzfs_super super;
+
+/******************************************************************************
+* SECTION: 目录B+树
+* 平铺目录超过 JFS_DIR_FLAT_MAX_BLKS 块时转为按名字哈希的B+树：根节点固定在目录的
+* 第0块（经区段树映射），其余节点直接占用数据块。叶子中的记录按键升序紧密排列，
+* 索引项记录子树的最小键。查找、插入、删除只访问自根到叶子的一条路径；叶子满了
+* 自下而上分裂，变空的节点释放并从父节点摘除，不做合并。
+* 节点经驱动读写，由块缓存吸收重复访问；键同时是 readdir 的 cookie，按键序遍历。
+*******************************************************************************/
+
+/**
+ * @brief 名字的64位哈希 (FNV-1a)，取低63位且不为0，可直接用作 readdir 的 cookie
+ *
+ * @param name
+ * @return uint64_t
+ */
+uint64_t jfs_dtree_key(const char* name) {
+    uint64_t h = 14695981039346656037ull;
+
+    while (*name) {
+        h ^= (uint8_t)*name++;
+        h *= 1099511628211ull;
+    }
+    h &= INT64_MAX;
+    return h != 0 ? h : 1;
+}
+
+static int jfs_dtree_read_node(uint64_t blk, struct juzfs_dtree_header* dh) {
+    if (jfs_driver_read(JFS_DATA_OFS(blk), (uint8_t *)dh, JFS_BLK_SZ()) != 0) {
+        return -EIO;
+    }
+    return dh->magic == JFS_DTREE_MAGIC ? 0 : -EIO;
+}
+
+static int jfs_dtree_write_node(uint64_t blk, struct juzfs_dtree_header* dh) {
+    return jfs_driver_write(JFS_DATA_OFS(blk), (uint8_t *)dh, JFS_BLK_SZ());
+}
+
+static void jfs_dtree_init_node(struct juzfs_dtree_header* dh, int depth) {
+    memset(dh, 0, JFS_BLK_SZ());
+    dh->magic = JFS_DTREE_MAGIC;
+    dh->depth = depth;
+}
+
+static inline struct juzfs_dtree_rec* jfs_dtree_rec(uint8_t* recs, int ofs) {
+    return (struct juzfs_dtree_rec *)(recs + ofs);
+}
+
+/**
+ * @brief 节点的分配与释放，目录的 size 记为B+树占用的字节数
+ */
+static int jfs_dtree_alloc_node(struct juzfs_inode* dir) {
+    int blk = jfs_alloc_data_blk();
+
+    if (blk >= 0) {
+        dir->size += JFS_BLK_SZ();
+        jfs_inode_mark_dirty(dir);
+    }
+    return blk;
+}
+
+static void jfs_dtree_free_node(struct juzfs_inode* dir, uint64_t blk) {
+    jfs_dealloc_data_blk(blk);
+    dir->size -= JFS_BLK_SZ();
+    jfs_inode_mark_dirty(dir);
+}
+
+/**
+ * @brief 二分查找最后一个 key 不大于目标的索引项，首项不作下界
+ *
+ * @return int 项下标，不小于0
+ */
+static int jfs_dtree_search(struct juzfs_dtree_header* dh, uint64_t key) {
+    struct juzfs_dtree_idx* di = JFS_DTREE_IDX(dh);
+    int lo = 1, hi = dh->entries - 1, mid;
+
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+        if (di[mid].key <= key) {
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return hi;
+}
+
+/**
+ * @brief 叶子中第一条键不小于目标的记录的偏移，没有时为 used
+ */
+static int jfs_dtree_leaf_find(struct juzfs_dtree_header* dh, uint64_t key) {
+    uint8_t* recs = JFS_DTREE_RECS(dh);
+    int      ofs  = 0;
+
+    while (ofs < dh->used && jfs_dtree_rec(recs, ofs)->key < key) {
+        ofs += jfs_dtree_rec(recs, ofs)->rec_len;
+    }
+    return ofs;
+}
+
+static bool jfs_dtree_rec_match(struct juzfs_dtree_rec* rec, uint64_t key, const char* name) {
+    return rec->key == key && rec->name_len == strlen(name) && memcmp(rec->name, name, rec->name_len) == 0;
+}
+
+static void jfs_dtree_rec_to_ent(struct juzfs_dtree_rec* rec, struct juzfs_dtree_ent* ent) {
+    ent->key   = rec->key;
+    ent->ino   = rec->ino;
+    ent->ftype = (JFS_FILE_TYPE)rec->ftype;
+    memcpy(ent->name, rec->name, rec->name_len);
+    ent->name[rec->name_len] = '\0';
+}
+
+/**
+ * @brief 自根向下找到键所在的叶子，记下沿途各层的节点、块号与所选的索引项，
+ * 节点放在调用者的临时区中
+ *
+ * @param path 输出，path[0] 为根，path[depth] 为叶子
+ * @return int 树的深度，出错返回负错误码
+ */
+static int jfs_dtree_descend(struct juzfs_inode* dir, uint64_t key, struct juzfs_dtree_header** path,
+                             uint64_t* blks, int* pos) {
+    int level = 0;
+
+    if (jfs_extent_map(dir, 0, &blks[0]) <= 0 || blks[0] == JFS_EXT_HOLE) {
+        return -EIO;
+    }
+    path[0] = (struct juzfs_dtree_header *)jfs_scratch_alloc(JFS_BLK_SZ());
+    if (jfs_dtree_read_node(blks[0], path[0]) != 0) {
+        return -EIO;
+    }
+    while (path[level]->depth > 0) {
+        if (level == JFS_DTREE_MAX_DEPTH) {
+            return -EIO;
+        }
+        pos[level]      = jfs_dtree_search(path[level], key);
+        blks[level + 1] = JFS_DTREE_IDX(path[level])[pos[level]].child;
+        path[level + 1] = (struct juzfs_dtree_header *)jfs_scratch_alloc(JFS_BLK_SZ());
+        if (jfs_dtree_read_node(blks[level + 1], path[level + 1]) != 0) {
+            return -EIO;
+        }
+        level++;
+    }
+    return level;
+}
+
+/**
+ * @brief 根节点已满：内容下移到新分配的节点，根变为只有一项的索引节点
+ *
+ * @param dir
+ * @return int
+ */
+static int jfs_dtree_grow(struct juzfs_inode* dir) {
+    struct juzfs_dtree_header* root;
+    struct juzfs_arena_mark    mark;
+    uint64_t root_blk;
+    int      blk = -1;
+    int      ret;
+
+    if (jfs_extent_map(dir, 0, &root_blk) <= 0 || root_blk == JFS_EXT_HOLE) {
+        return -EIO;
+    }
+    mark = jfs_scratch_mark();
+    root = (struct juzfs_dtree_header *)jfs_scratch_alloc(JFS_BLK_SZ());
+    ret  = jfs_dtree_read_node(root_blk, root);
+    if (ret == 0 && root->depth >= JFS_DTREE_MAX_DEPTH) {
+        ret = -ENOSPC;
+    }
+    if (ret == 0 && (blk = jfs_dtree_alloc_node(dir)) < 0) {
+        ret = -ENOSPC;
+    }
+    if (ret == 0 && (ret = jfs_dtree_write_node(blk, root)) == 0) {
+        jfs_dtree_init_node(root, root->depth + 1);
+        JFS_DTREE_IDX(root)[0].key   = 0;
+        JFS_DTREE_IDX(root)[0].child = blk;
+        root->entries = 1;
+        ret = jfs_dtree_write_node(root_blk, root);
+    }
+    jfs_scratch_release(mark);
+    return ret;
+}
+
+/**
+ * @brief 在索引节点的第 at 项处插入一项，调用者保证节点未满
+ */
+static void jfs_dtree_idx_put(struct juzfs_dtree_header* dh, int at, uint64_t key, uint64_t child) {
+    struct juzfs_dtree_idx* di = JFS_DTREE_IDX(dh);
+
+    memmove(&di[at + 1], &di[at], sizeof(struct juzfs_dtree_idx) * (dh->entries - at));
+    di[at].key   = key;
+    di[at].child = child;
+    dh->entries++;
+}
+
+/**
+ * @brief 在空的第0块上建立根叶子
+ *
+ * @param dir 目录inode，区段树中没有映射
+ * @return int
+ */
+static int jfs_dtree_create(struct juzfs_inode* dir) {
+    struct juzfs_dtree_header* root;
+    struct juzfs_arena_mark    mark;
+    int blk = jfs_dtree_alloc_node(dir);
+    int ret;
+
+    if (blk < 0) {
+        return -ENOSPC;
+    }
+    if (jfs_extent_insert(dir, 0, blk, 1) != 0) {
+        jfs_dtree_free_node(dir, blk);
+        return -ENOSPC;
+    }
+    mark = jfs_scratch_mark();
+    root = (struct juzfs_dtree_header *)jfs_scratch_alloc(JFS_BLK_SZ());
+    jfs_dtree_init_node(root, 0);
+    ret  = jfs_dtree_write_node(blk, root);
+    jfs_scratch_release(mark);
+    return ret;
+}
+
+/******************************************************************************
+* SECTION: 接口
+*******************************************************************************/
+/**
+ * @brief 按名字查找
+ *
+ * @param dir B+树目录
+ * @param name
+ * @param ent 输出，找到时填入
+ * @return int 0找到，-ENOENT 不存在，其余为IO错误
+ */
+int jfs_dtree_lookup(struct juzfs_inode* dir, const char* name, struct juzfs_dtree_ent* ent) {
+    struct juzfs_dtree_header* path[JFS_DTREE_MAX_DEPTH + 1];
+    uint64_t                   blks[JFS_DTREE_MAX_DEPTH + 1];
+    int                        pos[JFS_DTREE_MAX_DEPTH + 1];
+    struct juzfs_dtree_header* leaf;
+    struct juzfs_arena_mark    mark = jfs_scratch_mark();
+    uint64_t key = jfs_dtree_key(name);
+    int      depth, ofs;
+    int      ret = -ENOENT;
+
+    depth = jfs_dtree_descend(dir, key, path, blks, pos);
+    if (depth < 0) {
+        jfs_scratch_release(mark);
+        return depth;
+    }
+    leaf = path[depth];
+    ofs  = jfs_dtree_leaf_find(leaf, key);
+    if (ofs < leaf->used && jfs_dtree_rec_match(jfs_dtree_rec(JFS_DTREE_RECS(leaf), ofs), key, name)) {
+        jfs_dtree_rec_to_ent(jfs_dtree_rec(JFS_DTREE_RECS(leaf), ofs), ent);
+        ret = 0;
+    }
+    jfs_scratch_release(mark);
+    return ret;
+}
+
+/**
+ * @brief 插入一项。叶子放不下时按字节数对半分裂，已满的索引节点随之自下而上分裂，
+ * 根也满时先增高一层；分裂所需的节点先全部分配，不会分裂到一半失败
+ *
+ * @param dir
+ * @param name
+ * @param ino
+ * @param ftype
+ * @return int 同名项已存在（或63位键碰撞，极少见）时返回 -EEXIST
+ */
+int jfs_dtree_insert(struct juzfs_inode* dir, const char* name, uint32_t ino, JFS_FILE_TYPE ftype) {
+    struct juzfs_dtree_header* path[JFS_DTREE_MAX_DEPTH + 1];
+    uint64_t                   blks[JFS_DTREE_MAX_DEPTH + 1];
+    int                        pos[JFS_DTREE_MAX_DEPTH + 1];
+    int                        new_blks[JFS_DTREE_MAX_DEPTH + 1];
+    struct juzfs_dtree_header* leaf;
+    struct juzfs_dtree_header* node;
+    struct juzfs_dtree_rec*    rec;
+    struct juzfs_arena_mark    mark = jfs_scratch_mark();
+    uint8_t* buf;
+    uint64_t key      = jfs_dtree_key(name);
+    uint64_t sep;
+    int      name_len = strlen(name);
+    int      rec_len  = JFS_DTREE_REC_LEN(name_len);
+    int      depth, level, k, at, ofs, half, total, cnt;
+    int      ret = 0;
+
+    depth = jfs_dtree_descend(dir, key, path, blks, pos);
+    if (depth < 0) {
+        jfs_scratch_release(mark);
+        return depth;
+    }
+    leaf = path[depth];
+    ofs  = jfs_dtree_leaf_find(leaf, key);
+    if (ofs < leaf->used && jfs_dtree_rec(JFS_DTREE_RECS(leaf), ofs)->key == key) {
+        jfs_scratch_release(mark);
+        return -EEXIST;
+    }
+
+    total = leaf->used + rec_len;                       /* 新项按序放入临时区，放得下时直接写回 */
+    buf   = (uint8_t *)jfs_scratch_alloc(total);
+    memcpy(buf, JFS_DTREE_RECS(leaf), ofs);
+    memcpy(buf + ofs + rec_len, JFS_DTREE_RECS(leaf) + ofs, leaf->used - ofs);
+    rec = jfs_dtree_rec(buf, ofs);
+    memset(rec, 0, rec_len);
+    rec->key      = key;
+    rec->ino      = ino;
+    rec->ftype    = ftype;
+    rec->name_len = name_len;
+    rec->rec_len  = rec_len;
+    memcpy(rec->name, name, name_len);
+
+    if (total <= (int)JFS_DTREE_LEAF_CAP()) {
+        memcpy(JFS_DTREE_RECS(leaf), buf, total);
+        leaf->used = total;
+        leaf->entries++;
+        ret = jfs_dtree_write_node(blks[depth], leaf);
+        jfs_scratch_release(mark);
+        return ret;
+    }
+
+    for (level = depth - 1; level >= 0 && path[level]->entries == JFS_DTREE_IDX_MAX(); level--)
+        ;
+    if (level < 0) {
+        jfs_scratch_release(mark);
+        ret = jfs_dtree_grow(dir);
+        return ret != 0 ? ret : jfs_dtree_insert(dir, name, ino, ftype);
+    }
+    for (k = 0; k < depth - level; k++) {               /* 先分配分裂所需的全部节点 */
+        new_blks[k] = jfs_dtree_alloc_node(dir);
+        if (new_blks[k] < 0) {
+            while (--k >= 0) {
+                jfs_dtree_free_node(dir, new_blks[k]);
+            }
+            jfs_scratch_release(mark);
+            return -ENOSPC;
+        }
+    }
+
+    for (half = 0, cnt = 0; half < total / 2; cnt++) {  /* 在过半处的记录边界切开 */
+        half += jfs_dtree_rec(buf, half)->rec_len;
+    }
+    node = (struct juzfs_dtree_header *)jfs_scratch_alloc(JFS_BLK_SZ());
+    jfs_dtree_init_node(node, 0);
+    memcpy(JFS_DTREE_RECS(node), buf + half, total - half);
+    node->used    = total - half;
+    node->entries = leaf->entries + 1 - cnt;
+    memset(JFS_DTREE_RECS(leaf), 0, JFS_DTREE_LEAF_CAP());
+    memcpy(JFS_DTREE_RECS(leaf), buf, half);
+    leaf->used    = half;
+    leaf->entries = cnt;
+    if (jfs_dtree_write_node(blks[depth], leaf) != 0 || jfs_dtree_write_node(new_blks[0], node) != 0) {
+        ret = -EIO;
+    }
+    sep = jfs_dtree_rec(JFS_DTREE_RECS(node), 0)->key;
+
+    for (k = depth - 1; k > level; k--) {               /* 新节点作为索引项插入上一层，满了继续分裂 */
+        at   = pos[k] + 1;
+        half = path[k]->entries / 2;
+        jfs_dtree_init_node(node, path[k]->depth);
+        node->entries = path[k]->entries - half;
+        memcpy(JFS_DTREE_IDX(node), &JFS_DTREE_IDX(path[k])[half], sizeof(struct juzfs_dtree_idx) * node->entries);
+        path[k]->entries = half;
+        if (at > half) {
+            jfs_dtree_idx_put(node, at - half, sep, new_blks[depth - 1 - k]);
+        } else {
+            jfs_dtree_idx_put(path[k], at, sep, new_blks[depth - 1 - k]);
+        }
+        if (jfs_dtree_write_node(blks[k], path[k]) != 0 || jfs_dtree_write_node(new_blks[depth - k], node) != 0) {
+            ret = -EIO;
+        }
+        sep = JFS_DTREE_IDX(node)[0].key;
+    }
+    jfs_dtree_idx_put(path[level], pos[level] + 1, sep, new_blks[depth - 1 - level]);
+    if (jfs_dtree_write_node(blks[level], path[level]) != 0) {
+        ret = -EIO;
+    }
+    jfs_scratch_release(mark);
+    return ret;
+}
+
+/**
+ * @brief 删除一项；叶子变空时释放，并逐层从父节点摘除变空的节点，
+ * 根只剩一个子节点时把子节点收回根，树降低一层
+ *
+ * @param dir
+ * @param name
+ * @return int 不存在时返回 -ENOENT
+ */
+int jfs_dtree_delete(struct juzfs_inode* dir, const char* name) {
+    struct juzfs_dtree_header* path[JFS_DTREE_MAX_DEPTH + 1];
+    uint64_t                   blks[JFS_DTREE_MAX_DEPTH + 1];
+    int                        pos[JFS_DTREE_MAX_DEPTH + 1];
+    struct juzfs_dtree_header* leaf;
+    struct juzfs_dtree_header* root;
+    struct juzfs_dtree_idx*    di;
+    struct juzfs_arena_mark    mark = jfs_scratch_mark();
+    uint64_t key = jfs_dtree_key(name);
+    uint64_t child;
+    int      depth, level, ofs, rec_len;
+    int      ret = 0;
+
+    depth = jfs_dtree_descend(dir, key, path, blks, pos);
+    if (depth < 0) {
+        jfs_scratch_release(mark);
+        return depth;
+    }
+    leaf = path[depth];
+    ofs  = jfs_dtree_leaf_find(leaf, key);
+    if (ofs >= leaf->used || !jfs_dtree_rec_match(jfs_dtree_rec(JFS_DTREE_RECS(leaf), ofs), key, name)) {
+        jfs_scratch_release(mark);
+        return -ENOENT;
+    }
+    rec_len = jfs_dtree_rec(JFS_DTREE_RECS(leaf), ofs)->rec_len;
+    memmove(JFS_DTREE_RECS(leaf) + ofs, JFS_DTREE_RECS(leaf) + ofs + rec_len, leaf->used - ofs - rec_len);
+    memset(JFS_DTREE_RECS(leaf) + leaf->used - rec_len, 0, rec_len);
+    leaf->used -= rec_len;
+    leaf->entries--;
+
+    for (level = depth; level > 0 && path[level]->entries == 0; level--) {
+        jfs_dtree_free_node(dir, blks[level]);
+        di = JFS_DTREE_IDX(path[level - 1]);
+        memmove(&di[pos[level - 1]], &di[pos[level - 1] + 1],
+                sizeof(struct juzfs_dtree_idx) * (path[level - 1]->entries - pos[level - 1] - 1));
+        path[level - 1]->entries--;
+    }
+
+    root = path[0];
+    if (level == 0) {
+        while (root->depth > 0 && root->entries == 1) {
+            child = JFS_DTREE_IDX(root)[0].child;
+            if (jfs_dtree_read_node(child, root) != 0) {
+                jfs_scratch_release(mark);
+                return -EIO;
+            }
+            jfs_dtree_free_node(dir, child);
+        }
+        if (root->depth > 0 && root->entries == 0) {    /* 最后一个子树也删空了 */
+            jfs_dtree_init_node(root, 0);
+        }
+    }
+    if (jfs_dtree_write_node(blks[level], path[level]) != 0) {
+        ret = -EIO;
+    }
+    jfs_scratch_release(mark);
+    return ret;
+}
+
+/**
+ * @brief 改写一项指向的inode号
+ *
+ * @param dir
+ * @param name
+ * @param ino
+ * @return int 不存在时返回 -ENOENT
+ */
+int jfs_dtree_update(struct juzfs_inode* dir, const char* name, uint32_t ino) {
+    struct juzfs_dtree_header* path[JFS_DTREE_MAX_DEPTH + 1];
+    uint64_t                   blks[JFS_DTREE_MAX_DEPTH + 1];
+    int                        pos[JFS_DTREE_MAX_DEPTH + 1];
+    struct juzfs_dtree_header* leaf;
+    struct juzfs_arena_mark    mark = jfs_scratch_mark();
+    uint64_t key = jfs_dtree_key(name);
+    int      depth, ofs;
+    int      ret = -ENOENT;
+
+    depth = jfs_dtree_descend(dir, key, path, blks, pos);
+    if (depth < 0) {
+        jfs_scratch_release(mark);
+        return depth;
+    }
+    leaf = path[depth];
+    ofs  = jfs_dtree_leaf_find(leaf, key);
+    if (ofs < leaf->used && jfs_dtree_rec_match(jfs_dtree_rec(JFS_DTREE_RECS(leaf), ofs), key, name)) {
+        jfs_dtree_rec(JFS_DTREE_RECS(leaf), ofs)->ino = ino;
+        ret = jfs_dtree_write_node(blks[depth], leaf);
+    }
+    jfs_scratch_release(mark);
+    return ret;
+}
+
+/**
+ * @brief 按键序取出键大于 after 的至多 max 项。一个叶子取完时，
+ * 从下降时记下的下一棵子树的最小键重新自根向下
+ *
+ * @param dir
+ * @param after 上次取出的最后一项的键，0 表示从头开始
+ * @param ents 输出
+ * @param max
+ * @return int 取出的项数，0 表示已遍历完，出错返回负错误码
+ */
+int jfs_dtree_scan(struct juzfs_inode* dir, uint64_t after, struct juzfs_dtree_ent* ents, int max) {
+    struct juzfs_dtree_header* path[JFS_DTREE_MAX_DEPTH + 1];
+    uint64_t                   blks[JFS_DTREE_MAX_DEPTH + 1];
+    int                        pos[JFS_DTREE_MAX_DEPTH + 1];
+    struct juzfs_dtree_header* leaf;
+    struct juzfs_arena_mark    mark;
+    uint64_t key = after + 1;
+    uint64_t limit;
+    int      depth, level, ofs;
+    int      n = 0;
+
+    while (n < max) {
+        mark  = jfs_scratch_mark();
+        depth = jfs_dtree_descend(dir, key, path, blks, pos);
+        if (depth < 0) {
+            jfs_scratch_release(mark);
+            return depth;
+        }
+        limit = 0;                                      /* 右侧最近的子树的下界，0 表示没有 */
+        for (level = 0; level < depth; level++) {
+            if (pos[level] + 1 < path[level]->entries) {
+                limit = JFS_DTREE_IDX(path[level])[pos[level] + 1].key;
+            }
+        }
+        leaf = path[depth];
+        for (ofs = jfs_dtree_leaf_find(leaf, key); ofs < leaf->used && n < max;
+             ofs += jfs_dtree_rec(JFS_DTREE_RECS(leaf), ofs)->rec_len) {
+            jfs_dtree_rec_to_ent(jfs_dtree_rec(JFS_DTREE_RECS(leaf), ofs), &ents[n++]);
+        }
+        jfs_scratch_release(mark);
+        if (limit == 0) {
+            break;
+        }
+        key = limit;
+    }
+    return n;
+}
+
+/**
+ * @brief 平铺目录转为B+树：释放原有目录块，在第0块建空的根叶子，再逐项插入
+ *
+ * @param dir 变长目录项的平铺目录，须完整在内存中
+ * @return int 空闲块不足时返回 -ENOSPC，目录保持原样；释放原目录块失败时返回其错误码，目录仍为平铺
+ */
+int jfs_dtree_build(struct juzfs_inode* dir) {
+    uint64_t bytes = 0;
+    int      ret   = 0;
+
+    for (int i = 0; i < dir->dir_loaded; i++) {
+        if (dir->dentrys[i] != NULL) {
+            bytes += JFS_DTREE_REC_LEN(strlen(dir->dentrys[i]->name));
+        }
+    }
+    if (super.data_bm.nfree < (int)(2 * bytes / JFS_DTREE_LEAF_CAP()) + JFS_DTREE_MAX_DEPTH + 2) {
+        return -ENOSPC;                                 /* 逐项插入时叶子最少半满 */
+    }
+
+    ret = jfs_extent_truncate(dir, 0);
+    if (ret != 0) {                                     /* 原目录块未全部释放，不能在其上建树 */
+        return ret;
+    }
+    dir->size   = 0;
+    dir->flags |= JFS_INODE_DTREE;
+    jfs_inode_mark_dirty(dir);
+    ret = jfs_dtree_create(dir);
+    for (int i = 0; ret == 0 && i < dir->dir_loaded; i++) {
+        if (dir->dentrys[i] != NULL) {
+            ret = jfs_dtree_insert(dir, dir->dentrys[i]->name, dir->dentrys[i]->ino, dir->dentrys[i]->ftype);
+        }
+    }
+    return ret;
+}
+
+static void jfs_dtree_free_subtree(struct juzfs_inode* dir, uint64_t blk) {
+    struct juzfs_arena_mark    mark = jfs_scratch_mark();
+    struct juzfs_dtree_header* dh   = (struct juzfs_dtree_header *)jfs_scratch_alloc(JFS_BLK_SZ());
+
+    if (jfs_dtree_read_node(blk, dh) == 0) {
+        for (int i = 0; dh->depth > 0 && i < dh->entries; i++) {
+            jfs_dtree_free_subtree(dir, JFS_DTREE_IDX(dh)[i].child);
+        }
+    }
+    jfs_dtree_free_node(dir, blk);
+    jfs_scratch_release(mark);
+}
+
+/**
+ * @brief 释放整棵B+树，包括第0块上的根；只用于删除目录
+ *
+ * @param dir
+ */
+void jfs_dtree_destroy(struct juzfs_inode* dir) {
+    struct juzfs_dtree_header* root;
+    struct juzfs_arena_mark    mark = jfs_scratch_mark();
+    uint64_t root_blk;
+
+    root = (struct juzfs_dtree_header *)jfs_scratch_alloc(JFS_BLK_SZ());
+    if (jfs_extent_map(dir, 0, &root_blk) > 0 && root_blk != JFS_EXT_HOLE &&
+        jfs_dtree_read_node(root_blk, root) == 0) {
+        for (int i = 0; root->depth > 0 && i < root->entries; i++) {
+            jfs_dtree_free_subtree(dir, JFS_DTREE_IDX(root)[i].child);
+        }
+    }
+    jfs_scratch_release(mark);
+    jfs_extent_truncate(dir, 0);
+    dir->size = 0;
+}
@@ -0,0 +1,550 @@
+#include "juzfs.h"
+#include "types.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+extern struct juzfs_super super;
+
+/******************************************************************************
+* SECTION: 区段树
+* 文件块到数据块的映射按区段组织成B+树：根节点嵌在inode中，放满后整体下移到
+* 新的数据块，树增高一层；叶子项按 lblk 升序，索引项记录子树的首个文件块。
+* 写入空洞时可在任意位置插入，叶子满了自下而上分裂；截断只从尾部进行。
+* 非根节点经驱动读写，由块缓存吸收重复访问。
+*******************************************************************************/
+
+/**
+ * @brief 初始化inode中的空树
+ *
+ * @param inode
+ */
+void jfs_extent_init(struct juzfs_inode* inode) {
+    memset(&inode->ext_root, 0, sizeof(struct juzfs_extent_root));
+    inode->ext_root.eh.magic = JFS_EXT_MAGIC;
+    inode->ext_root.eh.max   = JFS_EXT_ROOT_CNT;
+    inode->ext_last.len      = 0;
+}
+
+static int jfs_ext_read_node(uint64_t blk, struct juzfs_extent_header* eh) {
+    if (jfs_driver_read(JFS_DATA_OFS(blk), (uint8_t *)eh, JFS_BLK_SZ()) != 0) {
+        return -EIO;
+    }
+    return eh->magic == JFS_EXT_MAGIC ? 0 : -EIO;
+}
+
+static int jfs_ext_write_node(uint64_t blk, struct juzfs_extent_header* eh) {
+    return jfs_driver_write(JFS_DATA_OFS(blk), (uint8_t *)eh, JFS_BLK_SZ());
+}
+
+/**
+ * @brief 二分查找最后一个 lblk 不大于目标的项，叶子项与索引项的 lblk 位置相同
+ *
+ * @return int 项下标，目标在首项之前时返回-1
+ */
+static int jfs_ext_search(struct juzfs_extent_header* eh, uint32_t lblk) {
+    struct juzfs_extent* ee = JFS_EXT_FIRST(eh);
+    int lo = 0, hi = eh->entries - 1, mid;
+
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+        if (ee[mid].lblk <= lblk) {
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return hi;
+}
+
+/**
+ * @brief 查找文件块对应的数据块，先查上次命中的区段，否则自根向下逐层二分
+ *
+ * @param inode
+ * @param lblk 文件块号
+ * @param pblk 输出，数据块号，落在空洞中时为 JFS_EXT_HOLE，预分配的区段带 JFS_EXT_UNWRITTEN
+ * @return int 从 lblk 起物理连续（或同为空洞）的块数，出错返回负错误码
+ */
+int jfs_extent_map(struct juzfs_inode* inode, uint32_t lblk, uint64_t* pblk) {
+    struct juzfs_extent*        last  = &inode->ext_last;
+    struct juzfs_extent_header* eh    = &inode->ext_root.eh;
+    struct juzfs_extent_header* node  = NULL;
+    struct juzfs_extent*        ee;
+    struct juzfs_arena_mark     mark;
+    uint64_t limit = JFS_EXT_MAX_BLKS;                  /* 下一个已映射区段的起点 */
+    int i;
+    int ret = 0;
+
+    if (last->len != 0 && lblk >= last->lblk && lblk - last->lblk < last->len) {
+        *pblk = last->pblk + (lblk - last->lblk);
+        return last->len - (lblk - last->lblk);
+    }
+
+    mark = jfs_scratch_mark();
+    while (eh->depth > 0) {
+        i = jfs_ext_search(eh, lblk);
+        if (i + 1 < eh->entries) {
+            limit = JFS_EXT_IDX(eh)[i + 1].lblk;
+        }
+        if (i < 0) {
+            break;
+        }
+        if (node == NULL) {
+            node = (struct juzfs_extent_header *)jfs_scratch_alloc(JFS_BLK_SZ());
+        }
+        if (jfs_ext_read_node(JFS_EXT_IDX(eh)[i].child, node) != 0) {
+            ret = -EIO;
+            break;
+        }
+        eh = node;
+    }
+
+    if (ret == 0 && eh->depth == 0) {
+        i  = jfs_ext_search(eh, lblk);
+        ee = i >= 0 ? &JFS_EXT_FIRST(eh)[i] : NULL;
+        if (ee != NULL && lblk - ee->lblk < ee->len) {
+            *last = *ee;
+            *pblk = ee->pblk + (lblk - ee->lblk);
+            ret   = ee->len - (lblk - ee->lblk);
+        } else if (i + 1 < eh->entries) {
+            limit = JFS_EXT_FIRST(eh)[i + 1].lblk;
+        }
+    }
+    if (ret == 0) {                                     /* 空洞一直延伸到下一个区段 */
+        *pblk = JFS_EXT_HOLE;
+        ret   = limit - lblk < INT32_MAX ? limit - lblk : INT32_MAX;
+    }
+    jfs_scratch_release(mark);
+    return ret;
+}
+
+static int jfs_ext_walk(struct juzfs_extent_header* eh, void (*fn)(void*, uint64_t, uint32_t), void* arg) {
+    struct juzfs_extent_header* child;
+    int i;
+
+    if (eh->depth == 0) {
+        for (i = 0; i < eh->entries; i++) {
+            fn(arg, JFS_EXT_PBLK(JFS_EXT_FIRST(eh)[i].pblk), JFS_EXT_FIRST(eh)[i].len);
+        }
+        return 0;
+    }
+    child = (struct juzfs_extent_header *)jfs_scratch_alloc(JFS_BLK_SZ());
+    for (i = 0; i < eh->entries; i++) {
+        fn(arg, JFS_EXT_IDX(eh)[i].child, 1);
+        if (jfs_ext_read_node(JFS_EXT_IDX(eh)[i].child, child) != 0 ||
+            jfs_ext_walk(child, fn, arg) != 0) {
+            return -EIO;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief 列出inode占用的全部数据块：每个区段（含预分配的），以及区段树的每个非根节点
+ *
+ * @param inode
+ * @param fn 每段调用一次，参数为数据块号与块数
+ * @param arg
+ * @return int
+ */
+int jfs_extent_walk(struct juzfs_inode* inode, void (*fn)(void*, uint64_t, uint32_t), void* arg) {
+    struct juzfs_arena_mark mark = jfs_scratch_mark();
+    int ret = jfs_ext_walk(&inode->ext_root.eh, fn, arg);
+
+    jfs_scratch_release(mark);
+    return ret;
+}
+
+/**
+ * @brief 根节点已满：内容下移到新分配的节点，根变为只有一项的索引节点
+ *
+ * @param inode
+ * @return int
+ */
+static int jfs_ext_grow(struct juzfs_inode* inode) {
+    struct juzfs_extent_header* root = &inode->ext_root.eh;
+    struct juzfs_extent_header* node;
+    struct juzfs_arena_mark     mark;
+    int blk;
+    int ret;
+
+    if (root->depth >= JFS_EXT_MAX_DEPTH) {
+        return -EFBIG;
+    }
+    blk = jfs_alloc_data_blk();
+    if (blk < 0) {
+        return -ENOSPC;
+    }
+
+    mark = jfs_scratch_mark();
+    node = (struct juzfs_extent_header *)jfs_scratch_alloc(JFS_BLK_SZ());
+    memset(node, 0, JFS_BLK_SZ());
+    memcpy(node, root, sizeof(struct juzfs_extent_header) + sizeof(struct juzfs_extent) * root->entries);
+    node->max = JFS_EXT_NODE_MAX();
+    ret = jfs_ext_write_node(blk, node);
+    if (ret == 0) {
+        memset(inode->ext_root.ee, 0, sizeof(inode->ext_root.ee));
+        JFS_EXT_IDX(root)[0].lblk  = JFS_EXT_FIRST(node)[0].lblk;
+        JFS_EXT_IDX(root)[0].child = blk;
+        root->entries = 1;
+        root->depth++;
+        jfs_inode_mark_dirty(inode);
+    } else {
+        jfs_dealloc_data_blk(blk);
+    }
+    jfs_scratch_release(mark);
+    return ret;
+}
+
+/**
+ * @brief 在节点的第 at 项处插入一项，调用者保证节点未满；
+ * 索引项与叶子项大小、布局相同，统一按 juzfs_extent 搬移
+ */
+static void jfs_ext_put(struct juzfs_extent_header* eh, int at, const struct juzfs_extent* e) {
+    struct juzfs_extent* ee = JFS_EXT_FIRST(eh);
+
+    memmove(&ee[at + 1], &ee[at], sizeof(struct juzfs_extent) * (eh->entries - at));
+    ee[at] = *e;
+    eh->entries++;
+}
+
+/**
+ * @brief 插入映射 [lblk, lblk + len) -> [pblk, pblk + len)，该范围此前必须是空洞。
+ * 与左右相邻的区段物理连续时直接合并；叶子已满时自下而上分裂到第一个有空位的节点，
+ * 根也满时先增高一层。在节点末尾插入（顺序追加）时新节点只放新项，已满的节点不再拆半
+ *
+ * @param inode
+ * @param lblk
+ * @param pblk 可带 JFS_EXT_UNWRITTEN，只与标记相同的区段合并
+ * @param len
+ * @return int
+ */
+int jfs_extent_insert(struct juzfs_inode* inode, uint32_t lblk, uint64_t pblk, uint32_t len) {
+    struct juzfs_extent_header* path[JFS_EXT_MAX_DEPTH + 1];
+    uint64_t                    blks[JFS_EXT_MAX_DEPTH + 1];
+    int                         pos[JFS_EXT_MAX_DEPTH + 1];
+    bool                        dirty[JFS_EXT_MAX_DEPTH + 1];
+    int                         new_blks[JFS_EXT_MAX_DEPTH];
+    struct juzfs_extent_header* eh;
+    struct juzfs_extent_header* node;
+    struct juzfs_extent*        ee;
+    struct juzfs_extent         e = { lblk, len, pblk };
+    struct juzfs_arena_mark     mark;
+    int depth = inode->ext_root.eh.depth;
+    int level, k, at, half;
+    bool append;
+    int ret   = 0;
+
+    inode->ext_last.len = 0;
+    mark    = jfs_scratch_mark();
+    path[0] = &inode->ext_root.eh;
+    for (level = 0; level < depth; level++) {           /* 自根向下找到覆盖 lblk 的叶子 */
+        eh           = path[level];
+        pos[level]   = jfs_ext_search(eh, lblk);
+        dirty[level] = false;
+        if (pos[level] < 0) {                           /* 插在整棵树最前面，下调首项的下界 */
+            pos[level]                = 0;
+            JFS_EXT_IDX(eh)[0].lblk   = lblk;
+            dirty[level]              = true;
+        }
+        path[level + 1] = (struct juzfs_extent_header *)jfs_scratch_alloc(JFS_BLK_SZ());
+        blks[level + 1] = JFS_EXT_IDX(eh)[pos[level]].child;
+        if (jfs_ext_read_node(blks[level + 1], path[level + 1]) != 0) {
+            jfs_scratch_release(mark);
+            return -EIO;
+        }
+    }
+    dirty[depth] = false;
+
+    eh = path[depth];
+    ee = JFS_EXT_FIRST(eh);
+    at = jfs_ext_search(eh, lblk) + 1;
+    if (at > 0 && ee[at - 1].lblk + ee[at - 1].len == lblk &&
+        ee[at - 1].pblk + ee[at - 1].len == pblk && (uint64_t)ee[at - 1].len + len <= UINT32_MAX) {
+        ee[at - 1].len += len;                          /* 接在左邻之后 */
+        if (at < eh->entries && lblk + len == ee[at].lblk && pblk + len == ee[at].pblk &&
+            (uint64_t)ee[at - 1].len + ee[at].len <= UINT32_MAX) {
+            ee[at - 1].len += ee[at].len;               /* 恰好填满两段之间的空洞 */
+            memmove(&ee[at], &ee[at + 1], sizeof(struct juzfs_extent) * (eh->entries - at - 1));
+            eh->entries--;
+        }
+        dirty[depth] = true;
+        level        = -1;
+    } else if (at < eh->entries && lblk + len == ee[at].lblk && pblk + len == ee[at].pblk &&
+               (uint64_t)ee[at].len + len <= UINT32_MAX) {
+        ee[at].lblk  = lblk;                            /* 接在右邻之前 */
+        ee[at].pblk  = pblk;
+        ee[at].len  += len;
+        dirty[depth] = true;
+        level        = -1;
+    } else {
+        for (level = depth; level >= 0 && path[level]->entries == path[level]->max; level--)
+            ;
+        if (level < 0) {
+            jfs_scratch_release(mark);
+            ret = jfs_ext_grow(inode);
+            return ret != 0 ? ret : jfs_extent_insert(inode, lblk, pblk, len);
+        }
+    }
+
+    for (k = 0; level >= 0 && k < depth - level; k++) { /* 先分配分裂所需的全部节点 */
+        new_blks[k] = jfs_alloc_data_blk();
+        if (new_blks[k] < 0) {
+            while (--k >= 0) {
+                jfs_dealloc_data_blk(new_blks[k]);
+            }
+            jfs_scratch_release(mark);
+            return -ENOSPC;
+        }
+    }
+
+    if (level >= 0) {
+        node = (struct juzfs_extent_header *)jfs_scratch_alloc(JFS_BLK_SZ());
+        for (k = depth; k > level; k--) {               /* 自叶子向上逐层分裂 */
+            eh = path[k];
+            memset(node, 0, JFS_BLK_SZ());
+            node->magic = JFS_EXT_MAGIC;
+            node->max   = JFS_EXT_NODE_MAX();
+            node->depth = eh->depth;
+            append      = at == eh->entries;
+            half        = append ? eh->entries : eh->entries / 2;
+            node->entries = eh->entries - half;
+            memcpy(JFS_EXT_FIRST(node), &JFS_EXT_FIRST(eh)[half], sizeof(struct juzfs_extent) * node->entries);
+            eh->entries = half;
+            if (append || at > half) {
+                jfs_ext_put(node, at - half, &e);
+            } else {
+                jfs_ext_put(eh, at, &e);
+            }
+            if (jfs_ext_write_node(blks[k], eh) != 0 ||
+                jfs_ext_write_node(new_blks[depth - k], node) != 0) {
+                ret = -EIO;
+            }
+            dirty[k] = false;
+            e.lblk   = JFS_EXT_FIRST(node)[0].lblk;     /* 新节点作为索引项插入上一层 */
+            e.len    = 0;
+            e.pblk   = new_blks[depth - k];
+            at       = pos[k - 1] + 1;
+        }
+        jfs_ext_put(path[level], at, &e);
+        dirty[level] = true;
+    }
+
+    if (dirty[0]) {                                     /* 根在inode中，随inode写回 */
+        jfs_inode_mark_dirty(inode);
+    }
+    for (k = 1; k <= depth; k++) {
+        if (dirty[k] && jfs_ext_write_node(blks[k], path[k]) != 0) {
+            ret = -EIO;
+        }
+    }
+    jfs_scratch_release(mark);
+    return ret;
+}
+
+/**
+ * @brief 把覆盖 lblk 的预分配区段中 [lblk, lblk + len) 标为已写。区段只被覆盖一部分时原地缩短，
+ * 其余部分重新插入；紧接在已写且物理相邻的左邻之后时并入左邻，顺序写满预分配区间时区段数不增长
+ */
+static int jfs_ext_convert_one(struct juzfs_inode* inode, uint32_t lblk, uint32_t len) {
+    struct juzfs_extent_header* eh = &inode->ext_root.eh;
+    struct juzfs_extent_header* node;
+    struct juzfs_extent*        ee;
+    struct juzfs_extent*        left;
+    struct juzfs_extent         rest[2];
+    struct juzfs_arena_mark     mark;
+    uint64_t blk = 0;
+    uint64_t pblk;
+    uint32_t start, cnt;
+    int      i, nrest = 0;
+    int      ret = 0;
+
+    mark = jfs_scratch_mark();
+    while (eh->depth > 0) {
+        i    = jfs_ext_search(eh, lblk);
+        blk  = JFS_EXT_IDX(eh)[i < 0 ? 0 : i].child;
+        node = (struct juzfs_extent_header *)jfs_scratch_alloc(JFS_BLK_SZ());
+        if (i < 0 || jfs_ext_read_node(blk, node) != 0) {
+            jfs_scratch_release(mark);
+            return -EIO;
+        }
+        eh = node;
+    }
+    i = jfs_ext_search(eh, lblk);
+    if (i < 0) {
+        jfs_scratch_release(mark);
+        return -EIO;
+    }
+    ee    = &JFS_EXT_FIRST(eh)[i];
+    left  = i > 0 ? &JFS_EXT_FIRST(eh)[i - 1] : NULL;
+    start = ee->lblk;
+    cnt   = ee->len;
+    pblk  = JFS_EXT_PBLK(ee->pblk);
+
+    if (lblk == start) {
+        if (left != NULL && left->lblk + left->len == start && left->pblk + left->len == pblk &&
+            (uint64_t)left->len + len <= UINT32_MAX) {
+            left->len += len;                           /* 并入左邻 */
+            if (len == cnt) {
+                memmove(ee, ee + 1, sizeof(struct juzfs_extent) * (eh->entries - i - 1));
+                eh->entries--;
+            } else {
+                ee->lblk += len;
+                ee->pblk += len;
+                ee->len  -= len;
+            }
+        } else {
+            ee->pblk = pblk;
+            ee->len  = len;
+            if (len < cnt) {
+                rest[nrest++] = (struct juzfs_extent){ start + len, cnt - len, (pblk + len) | JFS_EXT_UNWRITTEN };
+            }
+        }
+    } else {
+        ee->len = lblk - start;
+        rest[nrest++] = (struct juzfs_extent){ lblk, len, pblk + (lblk - start) };
+        if (lblk + len < start + cnt) {
+            rest[nrest++] = (struct juzfs_extent){ lblk + len, start + cnt - lblk - len,
+                                                   (pblk + (lblk + len - start)) | JFS_EXT_UNWRITTEN };
+        }
+    }
+    if (eh != &inode->ext_root.eh) {
+        ret = jfs_ext_write_node(blk, eh);
+    } else {                                            /* 根随inode写回 */
+        jfs_inode_mark_dirty(inode);
+    }
+    jfs_scratch_release(mark);
+    inode->ext_last.len = 0;
+
+    for (i = 0; ret == 0 && i < nrest; i++) {
+        ret = jfs_extent_insert(inode, rest[i].lblk, rest[i].pblk, rest[i].len);
+    }
+    return ret;
+}
+
+/**
+ * @brief 数据写入预分配的块之后，把 [lblk, lblk + len) 中未写的区段转为已写，已写部分与空洞跳过
+ *
+ * @param inode
+ * @param lblk
+ * @param len
+ * @return int 节点分裂所需的块不足时返回 -ENOSPC，尚未转换的区段保持未写
+ */
+int jfs_extent_convert(struct juzfs_inode* inode, uint32_t lblk, uint32_t len) {
+    uint64_t end = (uint64_t)lblk + len;
+    uint64_t pblk;
+    int      run;
+    int      ret;
+
+    while (lblk < end) {
+        run = jfs_extent_map(inode, lblk, &pblk);
+        if (run <= 0) {
+            return run < 0 ? run : -EIO;
+        }
+        run = end - lblk < (uint64_t)run ? end - lblk : (uint64_t)run;
+        if (JFS_EXT_IS_UNWRITTEN(pblk)) {
+            if (super.data_bm.nfree < 2 * (inode->ext_root.eh.depth + 2)) {
+                return -ENOSPC;                         /* 两次插入最坏各分裂到根 */
+            }
+            ret = jfs_ext_convert_one(inode, lblk, run);
+            if (ret != 0) {
+                return ret;
+            }
+        }
+        lblk += run;
+    }
+    return 0;
+}
+
+/**
+ * @brief 释放节点中 nblks 及之后的文件块，变空的子节点一并释放；
+ * 保留下来的最右子节点写回，其左侧的子树不受影响
+ *
+ * @param eh 调用者负责写回
+ * @param nblks
+ * @return int
+ */
+static int jfs_ext_trim(struct juzfs_extent_header* eh, uint32_t nblks) {
+    struct juzfs_extent_header* child;
+    struct juzfs_extent*        ee;
+    struct juzfs_extent_idx*    ei;
+    uint32_t keep;
+    int      ret;
+
+    if (eh->depth == 0) {
+        while (eh->entries > 0) {
+            ee = &JFS_EXT_FIRST(eh)[eh->entries - 1];
+            if (ee->lblk + ee->len <= nblks) {
+                break;
+            }
+            keep = ee->lblk < nblks ? nblks - ee->lblk : 0;
+            jfs_dealloc_data_blks(JFS_EXT_PBLK(ee->pblk) + keep, ee->len - keep);
+            if (keep > 0) {
+                ee->len = keep;
+                break;
+            }
+            eh->entries--;
+        }
+        return 0;
+    }
+
+    child = (struct juzfs_extent_header *)jfs_scratch_alloc(JFS_BLK_SZ());
+    while (eh->entries > 0) {
+        ei = &JFS_EXT_IDX(eh)[eh->entries - 1];
+        if (jfs_ext_read_node(ei->child, child) != 0) {
+            return -EIO;
+        }
+        ret = jfs_ext_trim(child, nblks);
+        if (ret != 0) {
+            return ret;
+        }
+        if (child->entries > 0) {
+            return jfs_ext_write_node(ei->child, child);
+        }
+        jfs_dealloc_data_blk(ei->child);
+        eh->entries--;
+    }
+    return 0;
+}
+
+/**
+ * @brief 释放文件块 nblks 及之后的全部映射；根只剩一个子节点且放得下时收回到inode，树降低一层
+ *
+ * @param inode
+ * @param nblks 保留的文件块数
+ * @return int
+ */
+int jfs_extent_truncate(struct juzfs_inode* inode, uint32_t nblks) {
+    struct juzfs_extent_header* root = &inode->ext_root.eh;
+    struct juzfs_extent_header* child;
+    struct juzfs_extent_root    old  = inode->ext_root;
+    struct juzfs_arena_mark     mark = jfs_scratch_mark();
+    uint64_t blk;
+    int      ret;
+
+    inode->ext_last.len = 0;
+    ret = jfs_ext_trim(root, nblks);
+    while (ret == 0 && root->depth > 0 && root->entries <= 1) {
+        if (root->entries == 0) {
+            root->depth = 0;
+            break;
+        }
+        blk   = JFS_EXT_IDX(root)[0].child;
+        child = (struct juzfs_extent_header *)jfs_scratch_alloc(JFS_BLK_SZ());
+        ret   = jfs_ext_read_node(blk, child);
+        if (ret != 0 || child->entries > JFS_EXT_ROOT_CNT) {
+            break;
+        }
+        memset(inode->ext_root.ee, 0, sizeof(inode->ext_root.ee));
+        memcpy(JFS_EXT_FIRST(root), JFS_EXT_FIRST(child), sizeof(struct juzfs_extent) * child->entries);
+        root->entries = child->entries;
+        root->depth   = child->depth;
+        jfs_dealloc_data_blk(blk);
+    }
+    if (memcmp(&old, &inode->ext_root, sizeof(old)) != 0) {
+        jfs_inode_mark_dirty(inode);
+    }
+    jfs_scratch_release(mark);
+    return ret;
+}
@@ -0,0 +1,304 @@
+#include "juzfs.h"
+#include "types.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+extern struct juzfs_super super;
+
+#ifdef JFS_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+/******************************************************************************
+* SECTION: io_uring 后端
+* 单个IO仍走 pread/pwrite；批量IO经 submit 进入提交队列（深度 queue_depth），
+* 由 wait 统一收割完成事件。io_uring 不可用时 submit 为同步执行。
+*******************************************************************************/
+struct jfs_uring {
+    int                     ring_fd;        /* -1 表示不可用，退化为同步 */
+    unsigned                entries;
+    unsigned                inflight;
+    int                     error;          /* 本批第一个错误 */
+
+    unsigned*               sq_head;
+    unsigned*               sq_tail;
+    unsigned*               sq_mask;
+    unsigned*               sq_array;
+    struct io_uring_sqe*    sqes;
+
+    unsigned*               cq_head;
+    unsigned*               cq_tail;
+    unsigned*               cq_mask;
+    struct io_uring_cqe*    cqes;
+
+    void*                   sq_ring;
+    size_t                  sq_ring_sz;
+    void*                   cq_ring;
+    size_t                  cq_ring_sz;
+    size_t                  sqes_sz;
+};
+
+static struct jfs_uring ring = { .ring_fd = -1 };
+
+static int jfs_uring_enter(unsigned to_submit, unsigned min_complete) {
+    int ret;
+
+    do {
+        ret = syscall(__NR_io_uring_enter, ring.ring_fd, to_submit, min_complete,
+                      min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+    return ret < 0 ? -errno : ret;
+}
+
+static int jfs_uring_setup(unsigned depth) {
+    struct io_uring_params p;
+
+    memset(&p, 0, sizeof(struct io_uring_params));
+    ring.ring_fd = syscall(__NR_io_uring_setup, depth, &p);
+    if (ring.ring_fd < 0) {
+        return -errno;
+    }
+
+    ring.entries    = p.sq_entries;
+    ring.sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring.cq_ring_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring.cq_ring_sz > ring.sq_ring_sz) {
+            ring.sq_ring_sz = ring.cq_ring_sz;
+        }
+        ring.cq_ring_sz = ring.sq_ring_sz;
+    }
+
+    ring.sq_ring = mmap(NULL, ring.sq_ring_sz, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring.ring_fd, IORING_OFF_SQ_RING);
+    if (ring.sq_ring == MAP_FAILED) {
+        goto err;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring.cq_ring = ring.sq_ring;
+    } else {
+        ring.cq_ring = mmap(NULL, ring.cq_ring_sz, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring.ring_fd, IORING_OFF_CQ_RING);
+        if (ring.cq_ring == MAP_FAILED) {
+            goto err;
+        }
+    }
+    ring.sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring.sqes    = mmap(NULL, ring.sqes_sz, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring.ring_fd, IORING_OFF_SQES);
+    if (ring.sqes == MAP_FAILED) {
+        goto err;
+    }
+
+    ring.sq_head  = (unsigned*)((uint8_t*)ring.sq_ring + p.sq_off.head);
+    ring.sq_tail  = (unsigned*)((uint8_t*)ring.sq_ring + p.sq_off.tail);
+    ring.sq_mask  = (unsigned*)((uint8_t*)ring.sq_ring + p.sq_off.ring_mask);
+    ring.sq_array = (unsigned*)((uint8_t*)ring.sq_ring + p.sq_off.array);
+    ring.cq_head  = (unsigned*)((uint8_t*)ring.cq_ring + p.cq_off.head);
+    ring.cq_tail  = (unsigned*)((uint8_t*)ring.cq_ring + p.cq_off.tail);
+    ring.cq_mask  = (unsigned*)((uint8_t*)ring.cq_ring + p.cq_off.ring_mask);
+    ring.cqes     = (struct io_uring_cqe*)((uint8_t*)ring.cq_ring + p.cq_off.cqes);
+    return 0;
+
+err:
+    close(ring.ring_fd);
+    ring.ring_fd = -1;
+    return -ENOMEM;
+}
+
+static void jfs_uring_teardown(void) {
+    if (ring.ring_fd < 0) {
+        return;
+    }
+    munmap(ring.sqes, ring.sqes_sz);
+    if (ring.cq_ring != ring.sq_ring) {
+        munmap(ring.cq_ring, ring.cq_ring_sz);
+    }
+    munmap(ring.sq_ring, ring.sq_ring_sz);
+    close(ring.ring_fd);
+    ring.ring_fd = -1;
+}
+
+/**
+ * @brief 收割已完成的事件，至少等待 min_complete 个
+ */
+static int jfs_uring_reap(unsigned min_complete) {
+    struct io_uring_cqe* cqe;
+    struct juzfs_io*     io;
+    unsigned             head;
+    int                  ret;
+
+    if (min_complete > 0) {
+        ret = jfs_uring_enter(0, min_complete);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    head = *ring.cq_head;
+    while (head != __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE)) {
+        cqe        = &ring.cqes[head & *ring.cq_mask];
+        io         = (struct juzfs_io*)(uintptr_t)cqe->user_data;
+        io->result = cqe->res;
+        if (cqe->res != io->size && ring.error == 0) {
+            ring.error = cqe->res < 0 ? cqe->res : -EIO;
+        }
+        ring.inflight--;
+        head++;
+    }
+    __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * @brief 收割到在途IO全部完成；进入内核等待失败时仍轮询完成队列，
+ * 内核终会完成已取走的提交项，不能在它们完成前返回
+ *
+ * @return int 等待失败时为 -EIO
+ */
+static int jfs_uring_drain(void) {
+    int ret = 0;
+
+    while (ring.inflight > 0) {
+        if (jfs_uring_reap(1) != 0) {
+            ret = -EIO;
+            jfs_uring_reap(0);
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief 提交队列中的 queued 项交给内核
+ *
+ * @return int 内核只取走一部分时为 -EAGAIN，其余留在提交队列
+ */
+static int jfs_uring_push(unsigned queued) {
+    int ret = jfs_uring_enter(queued, 0);
+
+    if (ret < 0) {
+        return ret;
+    }
+    ring.inflight += ret;
+    return (unsigned)ret < queued ? -EAGAIN : 0;
+}
+
+/**
+ * @brief 提交中途出错：撤回内核尚未取走的提交项，等已取走的完成后再返回，
+ * 调用者随即释放缓冲区；本批的错误随之作废，不影响下一批
+ */
+static void jfs_uring_cancel(void) {
+    __atomic_store_n(ring.sq_tail, __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+    jfs_uring_drain();
+    ring.error = 0;
+}
+
+static int jfs_uring_open(const char* path) {
+    int fd = jfs_file_open(path);
+
+    if (fd < 0) {
+        return fd;
+    }
+    ring.error    = 0;
+    ring.inflight = 0;
+    if (jfs_uring_setup(super.queue_depth) != 0) {
+        SFS_DBG("[%s] io_uring unavailable, using synchronous IO\n", __func__);
+    }
+    return fd;
+}
+
+static int jfs_uring_close(int fd) {
+    jfs_uring_teardown();
+    return close(fd);
+}
+
+/**
+ * @brief 提交一批IO，队列满时先收割完成事件腾出位置，不等待本批完成
+ *
+ * @param fd
+ * @param io 在 wait 返回前须保持有效
+ * @param cnt
+ * @return int 出错时已提交的IO均已完成，无需再 wait
+ */
+static int jfs_uring_submit(int fd, struct juzfs_io* io, int cnt) {
+    struct io_uring_sqe* sqe;
+    unsigned             tail;
+    unsigned             queued = 0;
+    int                  ret;
+    int                  i;
+
+    if (ring.ring_fd < 0) {
+        return jfs_dev_submit_sync(io, cnt);
+    }
+
+    for (i = 0; i < cnt; i++) {
+        if (ring.inflight + queued == ring.entries) {
+            ret    = jfs_uring_push(queued);
+            queued = 0;
+            if (ret == 0) {
+                ret = jfs_uring_reap(1);
+            }
+            if (ret != 0) {
+                jfs_uring_cancel();
+                return ret;
+            }
+        }
+
+        tail = *ring.sq_tail;
+        sqe  = &ring.sqes[tail & *ring.sq_mask];
+        memset(sqe, 0, sizeof(struct io_uring_sqe));
+        sqe->opcode    = io[i].is_write ? IORING_OP_WRITE : IORING_OP_READ;
+        sqe->fd        = fd;
+        sqe->off       = io[i].offset;
+        sqe->addr      = (uintptr_t)io[i].buf;
+        sqe->len       = io[i].size;
+        sqe->user_data = (uintptr_t)&io[i];
+        ring.sq_array[tail & *ring.sq_mask] = tail & *ring.sq_mask;
+        __atomic_store_n(ring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+        queued++;
+
+        jfs_file_count(&io[i]);
+    }
+
+    if (queued > 0) {
+        ret = jfs_uring_push(queued);
+        if (ret != 0) {
+            jfs_uring_cancel();
+            return ret;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief 等待已提交的全部IO完成
+ *
+ * @return int 本批第一个错误
+ */
+static int jfs_uring_wait(int fd) {
+    int ret = jfs_uring_drain();
+
+    if (ret == 0) {
+        ret = ring.error;
+    }
+    ring.error = 0;
+    return ret;
+}
+
+const struct juzfs_backend jfs_uring_backend = {
+    .name       = "uring",
+    .open       = jfs_uring_open,
+    .close      = jfs_uring_close,
+    .read       = jfs_file_read,
+    .write      = jfs_file_write,
+    .disk_size  = jfs_file_disk_size,
+    .io_size    = jfs_file_io_size,
+    .state      = jfs_file_state,
+    .submit     = jfs_uring_submit,
+    .wait       = jfs_uring_wait,
+    .sync       = jfs_file_sync,
+};
+#endif /* JFS_HAVE_IO_URING */
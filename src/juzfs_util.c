@@ -12,6 +12,14 @@ extern struct custom_options juzfs_options;
 
 int inode_cnt = 0;
 
+/**
+ * @brief inode槽大小须为2的幂，能容纳磁盘inode且不跨块
+ */
+static bool jfs_inode_sz_valid(int sz) {
+    return sz >= JFS_MIN_INODE_SZ && sz <= JFS_BLK_SZ() && (sz & (sz - 1)) == 0 &&
+           sz >= (int)sizeof(struct juzfs_inode_d);
+}
+
 /**
  * @brief 挂载sfs, Layout 如下
  * 
@@ -21,7 +29,8 @@ int inode_cnt = 0;
  * 
  * IO_SZ * 2 = BLK_SZ
  * 
- * 每个Inode占用一个Blk
+ * 格式化时选择inode槽大小，每块存放 BLK_SZ / inode_size 个inode；
+ * layout_version 为0的旧镜像每个Inode占用一个Blk，其中区段树之前的inode在读入时转换
  * @param options 
  * @return int 
  */
@@ -31,27 +40,54 @@ int jfs_mount(struct custom_options options){
     struct juzfs_super_d    juzfs_super_d; 
     struct juzfs_dentry*    root_dentry;
     struct juzfs_inode*     root_inode;
+    struct juzfs_iovec      iov[2];
 
     int                 inode_num;
     int                 data_blk_num;
     uint64_t            map_data_blks;
     uint64_t            map_inode_blks;
+    uint64_t            ino_list_blks;
+    int                 ino_per_blk;
+    int                 sz_inode;
     
     int                 super_blks;
     bool                is_init = false;
+    bool                is_clean;
 
     super.is_mounted = false;
 
-    // driver_fd = open(options.device, O_RDWR);
-    driver_fd = ddriver_open(options.device);
+    super.backend = jfs_backend_select(options.backend);
+    if (super.backend == NULL) {
+        SFS_DBG("[%s] unknown backend %s\n", __func__, options.backend);
+        return -EINVAL;
+    }
+
+    super.queue_depth = options.queue_depth > 0 ? options.queue_depth : JFS_DEFAULT_QUEUE_DEPTH;
+    driver_fd = JFS_BACKEND()->open(options.device);
 
     if (driver_fd < 0) {
         return driver_fd;
     }
 
     super.fd = driver_fd;
-    ddriver_ioctl(JFS_DRIVER(), IOC_REQ_DEVICE_SIZE,  &super.sz_disk);
-    ddriver_ioctl(JFS_DRIVER(), IOC_REQ_DEVICE_IO_SZ, &super.sz_io);
+    JFS_BACKEND()->disk_size(JFS_DRIVER(), &super.sz_disk);
+    JFS_BACKEND()->io_size(JFS_DRIVER(), &super.sz_io);
+
+    super.base = NULL;
+    if (JFS_BACKEND()->map != NULL) {                 /* 映射后直接访问设备，不再需要块缓存 */
+        super.base = JFS_BACKEND()->map(JFS_DRIVER(), JFS_DISK_SZ());
+        if (super.base == NULL) {
+            return -EIO;
+        }
+        options.cache_size = 0;
+    }
+
+    if (jfs_cache_init(options.cache_size * 1024) != 0) {
+        return -ENOMEM;
+    }
+    if (jfs_dcache_init(options.dcache_size) != 0) {
+        return -ENOMEM;
+    }
     
     root_dentry         = new_dentry("/", NULL,DIR_TYPE);
     root_dentry->ino    = JFS_ROOT_INO;
@@ -79,7 +115,17 @@ int jfs_mount(struct custom_options options){
         // 考虑其他数据结构占用空间后的实际最大inode
         inode_num       =  (JFS_DISK_SZ() - (super_blks + map_inode_blks + map_data_blks) * JFS_BLK_SZ()) / ((JFS_DATA_PER_FILE + JFS_INODE_PER_FILE) * JFS_BLK_SZ());
 
-        data_blk_num    = (inode_num / JFS_INODE_PER_FILE) * JFS_DATA_PER_FILE;
+        sz_inode        = jfs_inode_sz_valid(options.inode_size) ? options.inode_size 
+                                                                  : JFS_DEFAULT_INODE_SZ;
+        ino_per_blk     = JFS_BLK_SZ() / sz_inode;
+        ino_list_blks   = JFS_ROUND_UP(inode_num, ino_per_blk) / ino_per_blk;
+
+        // inode表压缩后省下的块归入数据区，不超过数据位图的容量
+        data_blk_num    = JFS_DISK_SZ() / JFS_BLK_SZ() - super_blks - map_inode_blks - map_data_blks 
+                          - ino_list_blks;
+        if ((uint64_t)data_blk_num > JFS_BLKS_SZ(map_data_blks) * UINT8_BITS) {
+            data_blk_num = JFS_BLKS_SZ(map_data_blks) * UINT8_BITS;
+        }
         
                                                       /* 布局layout */
         juzfs_super_d.max_ino           = inode_num; 
@@ -88,19 +134,35 @@ int jfs_mount(struct custom_options options){
         juzfs_super_d.max_data_blks     = data_blk_num;
         juzfs_super_d.map_data_blks     = map_data_blks;
         juzfs_super_d.map_data_offset   = juzfs_super_d.map_inode_offset + JFS_BLKS_SZ((uint64_t) map_inode_blks);
-        juzfs_super_d.ino_list_blks     = inode_num;
+        juzfs_super_d.ino_list_blks     = ino_list_blks;
         juzfs_super_d.ino_list_offset   = juzfs_super_d.map_data_offset + JFS_BLKS_SZ((uint64_t)map_data_blks);
-        juzfs_super_d.data_offset       = juzfs_super_d.ino_list_offset + JFS_BLKS_SZ((uint64_t)inode_num);
+        juzfs_super_d.data_offset       = juzfs_super_d.ino_list_offset + JFS_BLKS_SZ(ino_list_blks);
+        juzfs_super_d.layout_version    = JFS_LAYOUT_PACKED;
+        juzfs_super_d.sz_inode          = sz_inode;
 
         juzfs_super_d.sz_usage          = 0;
         is_init                         = true;
     }
 
-    super.sz_usage          = juzfs_super_d.sz_usage;      /* 建立 in-memory 结构 */
-    
-    super.max_ino           = juzfs_super_d.max_ino;
-    super.map_inode         = (uint8_t *)malloc(JFS_BLKS_SZ(juzfs_super_d.map_inode_blks));
-    super.map_data          = (uint8_t *)malloc(JFS_BLKS_SZ(juzfs_super_d.map_data_blks));
+    if (juzfs_super_d.layout_version == JFS_LAYOUT_LEGACY) {
+        super.sz_inode      = JFS_BLK_SZ();
+    } else if (juzfs_super_d.layout_version == JFS_LAYOUT_PACKED && 
+               jfs_inode_sz_valid(juzfs_super_d.sz_inode)) {
+        super.sz_inode      = juzfs_super_d.sz_inode;
+    } else {
+        SFS_DBG("[%s] unsupported layout version %u\n", __func__, juzfs_super_d.layout_version);
+        return -EINVAL;
+    }
+
+    super.layout_version    = juzfs_super_d.layout_version;
+    super.max_ino           = juzfs_super_d.max_ino;      /* 建立 in-memory 结构 */
+    if (JFS_DEV_MAPPED()) {                           /* 位图原地使用 */
+        super.map_inode     = jfs_dev_ptr(juzfs_super_d.map_inode_offset);
+        super.map_data      = jfs_dev_ptr(juzfs_super_d.map_data_offset);
+    } else {
+        super.map_inode     = (uint8_t *)jfs_malloc(JFS_BLKS_SZ(juzfs_super_d.map_inode_blks));
+        super.map_data      = (uint8_t *)jfs_malloc(JFS_BLKS_SZ(juzfs_super_d.map_data_blks));
+    }
     // super.inode_list = (struct juzfs_inode*)malloc(JFS_BLKS_SZ(juzfs_super_d.max_ino));
     super.map_inode_blks    = juzfs_super_d.map_inode_blks;
     super.map_inode_offset  = juzfs_super_d.map_inode_offset;
@@ -114,13 +176,14 @@ int jfs_mount(struct custom_options options){
 
     super.data_offset       = juzfs_super_d.data_offset;
 
-    if (jfs_driver_read(juzfs_super_d.map_inode_offset, (uint8_t *)(super.map_inode), 
-                        JFS_BLKS_SZ(juzfs_super_d.map_inode_blks)) != 0) {
-        return -EIO;
-    }
+    iov[0].offset = juzfs_super_d.map_inode_offset;   /* 两张位图相邻，一次读入 */
+    iov[0].buf    = super.map_inode;
+    iov[0].size   = JFS_BLKS_SZ(juzfs_super_d.map_inode_blks);
+    iov[1].offset = juzfs_super_d.map_data_offset;
+    iov[1].buf    = super.map_data;
+    iov[1].size   = JFS_BLKS_SZ(juzfs_super_d.map_data_blks);
 
-    if (jfs_driver_read(juzfs_super_d.map_data_offset, (uint8_t *)(super.map_data), 
-                        JFS_BLKS_SZ(juzfs_super_d.map_data_blks)) != 0) {
+    if (!JFS_DEV_MAPPED() && jfs_driver_readv(iov, 2) != 0) {
         return -EIO;
     }
 
@@ -130,121 +193,750 @@ int jfs_mount(struct custom_options options){
     // }
 
     if (is_init) {
-        // 保证位图为空
+        // 保证位图为空，格式化时整张写出一次，此后只写脏段
         memset(super.map_inode,0,JFS_BLKS_SZ(juzfs_super_d.map_inode_blks));
         memset(super.map_data,0,JFS_BLKS_SZ(juzfs_super_d.map_data_blks));
+        juzfs_super_d.flags = 0;
+        if (!JFS_DEV_MAPPED() && jfs_driver_writev(iov, 2) != 0) {
+            return -EIO;
+        }
+    }
+                                                      /* 未正常卸载时用popcount重建空闲计数 */
+    is_clean = juzfs_super_d.flags & JFS_SUPER_CLEAN;
+    if (jfs_bitmap_init(&super.ino_bm, super.map_inode, super.max_ino, 
+                        is_clean ? juzfs_super_d.free_inodes : -1, JFS_BLK_SZ()) != 0 ||
+        jfs_bitmap_init(&super.data_bm, super.map_data, super.max_data_blks, 
+                        is_clean ? juzfs_super_d.free_data_blks : -1, JFS_BLK_SZ()) != 0) {
+        return -ENOMEM;
+    }
+    super.sz_usage = JFS_BLKS_SZ((uint64_t)(super.max_data_blks - super.data_bm.nfree));
+                                                      /* 挂载期间清除clean标记，异常退出后重建；新格式化的 */
+    juzfs_super_d.magic = JFS_MAGIC;                  /* 镜像也写出，后台回写与 fsync 后崩溃仍可挂载 */
+    juzfs_super_d.flags = 0;
+    if (jfs_driver_write(JFS_SUPER_OFS, (uint8_t *)&juzfs_super_d, 
+                         sizeof(struct juzfs_super_d)) != 0) {
+        return -EIO;
+    }
 
-        /* 分配根节点 */
+    super.dirty_inodes = NULL;
+    super.dirty_tail   = &super.dirty_inodes;
+    if (is_init) {                                    /* 分配根节点 */
         root_inode = jfs_alloc_inode(root_dentry);
         jfs_sync_inode(root_inode);
     }
     
     root_inode          = jfs_read_inode(root_dentry, JFS_ROOT_INO);
+    if (root_inode == NULL) {                         /* 无法识别的inode格式 */
+        SFS_DBG("[%s] unsupported inode layout\n", __func__);
+        return -EINVAL;
+    }
     root_dentry->inode  = root_inode;
     super.root_dentry   = root_dentry;
     super.is_mounted    = true;
 
     jfs_dump_map();
+    jfs_dump_dev_state("mount");
 
     return ret;
 }
 
 /**
- * @brief 驱动读
+ * @brief 设备读，offset和size须与IO单位对齐
+ * 
+ * @param offset 
+ * @param out_content 
+ * @param size 
+ * @return int 
+ */
+int jfs_dev_read(uint64_t offset, uint8_t *out_content, int size) {
+    return JFS_BACKEND()->read(JFS_DRIVER(), offset, out_content, size);
+}
+
+/**
+ * @brief 设备写，offset和size须与IO单位对齐
+ * 
+ * @param offset 
+ * @param in_content 
+ * @param size 
+ * @return int 
+ */
+int jfs_dev_write(uint64_t offset, uint8_t *in_content, int size) {
+    return JFS_BACKEND()->write(JFS_DRIVER(), offset, in_content, size);
+}
+
+/**
+ * @brief 同步执行一批IO，供不支持异步提交的后端使用
+ * 
+ * @param io 
+ * @param cnt 
+ * @return int 
+ */
+int jfs_dev_submit_sync(struct juzfs_io *io, int cnt) {
+    int i;
+
+    for (i = 0; i < cnt; i++) {
+        io[i].result = io[i].is_write ? jfs_dev_write(io[i].offset, io[i].buf, io[i].size)
+                                      : jfs_dev_read(io[i].offset, io[i].buf, io[i].size);
+        if (io[i].result != 0) {
+            return -EIO;
+        }
+        io[i].result = io[i].size;
+    }
+    return 0;
+}
+
+/**
+ * @brief 提交一批IO，异步后端只入队不等待，调用者以 jfs_dev_wait 等待整批完成
+ * 
+ * @param io 在 jfs_dev_wait 返回前须保持有效
+ * @param cnt 
+ * @return int 
+ */
+int jfs_dev_submit(struct juzfs_io *io, int cnt) {
+    if (JFS_BACKEND()->submit == NULL) {
+        return jfs_dev_submit_sync(io, cnt);
+    }
+    return JFS_BACKEND()->submit(JFS_DRIVER(), io, cnt);
+}
+
+/**
+ * @brief 等待已提交的全部IO完成
+ * 
+ * @return int 
+ */
+int jfs_dev_wait(void) {
+    if (JFS_BACKEND()->wait == NULL) {
+        return 0;
+    }
+    return JFS_BACKEND()->wait(JFS_DRIVER());
+}
+
+/**
+ * @brief 设备已映射时返回offset处的指针，调用者可原地读写
+ * 
+ * @param offset 字节偏移
+ * @return uint8_t* 未映射时返回NULL
+ */
+uint8_t* jfs_dev_ptr(uint64_t offset) {
+    return JFS_DEV_MAPPED() ? super.base + offset : NULL;
+}
+
+/**
+ * @brief 将已写入设备的修改持久化：映射区 msync，文件镜像 fdatasync；ddriver 无此操作
+ * 
+ * @return int 
+ */
+int jfs_dev_sync(void) {
+    if (JFS_BACKEND()->sync == NULL) {
+        return 0;
+    }
+    return JFS_BACKEND()->sync(JFS_DRIVER());
+}
+
+/**
+ * @brief 驱动读，经过块缓存；缓存关闭时直接访问设备
  * 
  * @param offset 
  * @param out_content 
  * @param size 
  * @return int 
  */
-int jfs_driver_read(int offset, uint8_t *out_content, int size) {
-    int      offset_aligned = JFS_ROUND_DOWN(offset, JFS_IO_SZ());
-    int      bias           = offset - offset_aligned;
-    int      size_aligned   = JFS_ROUND_UP((size + bias), JFS_IO_SZ());
-    uint8_t* temp_content   = (uint8_t*)malloc(size_aligned);
-    uint8_t* cur            = temp_content;
-    // lseek(SFS_DRIVER(), offset_aligned, SEEK_SET);
-    ddriver_seek(JFS_DRIVER(), offset_aligned, SEEK_SET);
-    while (size_aligned != 0)
+int jfs_driver_read(uint64_t offset, uint8_t *out_content, int size) {
+    struct juzfs_buf* buf;
+    int      bias;
+    int      length;
+
+    if (JFS_DEV_MAPPED()) {                         /* 映射区直接拷贝，无对齐要求 */
+        memcpy(out_content, jfs_dev_ptr(offset), size);
+        return 0;
+    }
+
+    if (!jfs_cache_enabled()) {
+        uint64_t offset_aligned = JFS_ROUND_DOWN(offset, JFS_IO_SZ());
+        int      size_aligned   = JFS_ROUND_UP((size + offset - offset_aligned), JFS_IO_SZ());
+        struct juzfs_arena_mark mark = jfs_scratch_mark();
+        uint8_t* temp_content   = (uint8_t*)jfs_scratch_alloc(size_aligned);
+
+        if (jfs_dev_read(offset_aligned, temp_content, size_aligned) != 0) {
+            jfs_scratch_release(mark);
+            return -EIO;
+        }
+        memcpy(out_content, temp_content + offset - offset_aligned, size);
+        jfs_scratch_release(mark);
+        return 0;
+    }
+
+    while (size > 0)
     {
-        // read(SFS_DRIVER(), cur, SFS_IO_SZ());
-        ddriver_read(JFS_DRIVER(), cur, JFS_IO_SZ());
-        cur          += JFS_IO_SZ();
-        size_aligned -= JFS_IO_SZ();   
+        bias   = offset % JFS_BLK_SZ();
+        length = JFS_BLK_SZ() - bias < size ? JFS_BLK_SZ() - bias : size;
+        buf    = jfs_cache_get(offset / JFS_BLK_SZ());
+        if (buf == NULL) {
+            return -EIO;
+        }
+        memcpy(out_content, buf->data + bias, length);
+        out_content += length;
+        offset      += length;
+        size        -= length;
     }
-    memcpy(out_content, temp_content + bias, size);
-    free(temp_content);
     return 0;
 }
 
 /**
- * @brief 驱动写
+ * @brief 驱动写，写入块缓存并标脏，由淘汰或umount回写；缓存关闭时直接写设备
+ * 完整覆盖的IO单位不会先读出
  * 
  * @param offset 
  * @param in_content 
  * @param size 
  * @return int 
  */
-int jfs_driver_write(int offset, uint8_t *in_content, int size) {
-    int      offset_aligned = JFS_ROUND_DOWN(offset, JFS_IO_SZ());
-    int      bias           = offset - offset_aligned;
-    int      size_aligned   = JFS_ROUND_UP((size + bias), JFS_IO_SZ());
-    uint8_t* temp_content   = (uint8_t*)malloc(size_aligned);
-    uint8_t* cur            = temp_content;
+int jfs_driver_write(uint64_t offset, uint8_t *in_content, int size) {
+    struct juzfs_buf* buf;
+    int      bias;
+    int      length;
+    int      ret = 0;
+
+    if (JFS_DEV_MAPPED()) {
+        memcpy(jfs_dev_ptr(offset), in_content, size);
+        return 0;
+    }
 
-    jfs_driver_read(offset_aligned, temp_content, size_aligned);
-    memcpy(temp_content + bias, in_content, size);
-    
-    // lseek(SFS_DRIVER(), offset_aligned, SEEK_SET);
-    ddriver_seek(JFS_DRIVER(), offset_aligned, SEEK_SET);
-    while (size_aligned != 0)
-    {
-        // write(SFS_DRIVER(), cur, SFS_IO_SZ());
-        ddriver_write(JFS_DRIVER(), (char*)cur, JFS_IO_SZ());
-        cur          += JFS_IO_SZ();
-        size_aligned -= JFS_IO_SZ();   
+    if (!jfs_cache_enabled()) {
+        uint64_t offset_aligned = JFS_ROUND_DOWN(offset, JFS_IO_SZ());
+        int      size_aligned   = JFS_ROUND_UP((size + offset - offset_aligned), JFS_IO_SZ());
+        uint64_t tail_aligned   = offset_aligned + size_aligned - JFS_IO_SZ();
+        struct juzfs_arena_mark mark;
+        uint8_t* temp_content;
+
+        bias = offset - offset_aligned;
+        if (bias == 0 && size == size_aligned) {    /* 完整覆盖IO单位，直接写 */
+            return jfs_dev_write(offset_aligned, in_content, size) != 0 ? -EIO : 0;
+        }
+
+        mark         = jfs_scratch_mark();
+        temp_content = (uint8_t*)jfs_scratch_alloc(size_aligned);
+        if ((bias != 0 || size < JFS_IO_SZ()) &&    /* 只读入部分覆盖的首尾单位 */
+            jfs_dev_read(offset_aligned, temp_content, JFS_IO_SZ()) != 0) {
+            ret = -EIO;
+        }
+        if (ret == 0 && (offset + size) % JFS_IO_SZ() != 0 && tail_aligned != offset_aligned &&
+            jfs_dev_read(tail_aligned, temp_content + size_aligned - JFS_IO_SZ(), JFS_IO_SZ()) != 0) {
+            ret = -EIO;
+        }
+        if (ret == 0) {                             /* 首尾读失败时不能把未读出的内容写回设备 */
+            memcpy(temp_content + bias, in_content, size);
+            ret = jfs_dev_write(offset_aligned, temp_content, size_aligned) != 0 ? -EIO : 0;
+        }
+        jfs_scratch_release(mark);
+        return ret;
     }
 
-    free(temp_content);
+    while (size > 0)
+    {
+        bias   = offset % JFS_BLK_SZ();
+        length = JFS_BLK_SZ() - bias < size ? JFS_BLK_SZ() - bias : size;
+        buf    = jfs_cache_get_for_write(offset / JFS_BLK_SZ(), bias, length);
+        if (buf == NULL) {
+            return -EIO;
+        }
+        memcpy(buf->data + bias, in_content, length);
+        jfs_cache_mark_dirty(buf);
+        in_content += length;
+        offset     += length;
+        size       -= length;
+    }
     return 0;
 }
 
+static int jfs_cmp_iovec(const void* a, const void* b) {
+    uint64_t x = ((struct juzfs_iovec*)a)->offset;
+    uint64_t y = ((struct juzfs_iovec*)b)->offset;
+    return x < y ? -1 : (x > y);
+}
+
 /**
- * @brief 分配一个inode，占用位图
+ * @brief 将iov按设备偏移排序，返回从first开始物理相邻的一段的结束下标
  * 
- * @param dentry 该dentry指向分配的inode
- * @return sfs_inode
+ * @param iov 
+ * @param first 
+ * @param iovcnt 
+ * @return int 段后第一个下标
  */
-struct juzfs_inode* jfs_alloc_inode(struct juzfs_dentry * dentry) {
-    struct juzfs_inode* inode;
-    int byte_cursor = 0; 
-    int bit_cursor  = 0; 
-    int ino_cursor  = 0;
-    bool is_find_free_entry = false;
+static int jfs_iovec_run(struct juzfs_iovec* iov, int first, int iovcnt) {
+    int last = first + 1;
+    while (last < iovcnt && iov[last - 1].offset + iov[last - 1].size == iov[last].offset) {
+        last++;
+    }
+    return last;
+}
 
-    for (byte_cursor = 0; byte_cursor < JFS_BLKS_SZ(super.map_inode_blks); 
-         byte_cursor++)
-    {
-        for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++) {
-            if((super.map_inode[byte_cursor] & (0x1 << bit_cursor)) == 0) {    
-                                                      /* 当前ino_cursor位置空闲 */
-                super.map_inode[byte_cursor] |= (0x1 << bit_cursor);
-                inode_cnt++;
-                printf("allocated inode %s\n",dentry->name);
-                is_find_free_entry = true;           
-                break;
+/**
+ * @brief 向量读，iov按设备偏移排序后合并物理相邻的段，每段一次寻道和连续传输；
+ * 各段作为一批提交给后端，整批完成后返回
+ * 
+ * @param iov 读请求（会被重新排序）
+ * @param iovcnt 
+ * @return int 
+ */
+int jfs_driver_readv(struct juzfs_iovec* iov, int iovcnt) {
+    struct juzfs_arena_mark mark;
+    struct juzfs_io* io;
+    uint64_t start, end, start_aligned;
+    int      first, last, i;
+    int      iocnt = 0;
+    int      ret   = 0;
+
+    if (JFS_DEV_MAPPED()) {                         /* 无寻道开销，无需排序合并 */
+        for (i = 0; i < iovcnt; i++) {
+            jfs_driver_read(iov[i].offset, iov[i].buf, iov[i].size);
+        }
+        return 0;
+    }
+
+    qsort(iov, iovcnt, sizeof(struct juzfs_iovec), jfs_cmp_iovec);
+
+    if (jfs_cache_enabled()) {
+        for (first = 0; first < iovcnt; first = last) {
+            last  = jfs_iovec_run(iov, first, iovcnt);
+            start = iov[first].offset;
+            end   = iov[last - 1].offset + iov[last - 1].size;
+            if (jfs_cache_prefetch(start / JFS_BLK_SZ(), 
+                                   (end - 1) / JFS_BLK_SZ() - start / JFS_BLK_SZ() + 1) != 0) {
+                return -EIO;
+            }
+            for (i = first; i < last; i++) {
+                if (jfs_driver_read(iov[i].offset, iov[i].buf, iov[i].size) != 0) {
+                    return -EIO;
+                }
+            }
+        }
+        return 0;
+    }
+
+    mark = jfs_scratch_mark();
+    io   = (struct juzfs_io*)jfs_scratch_alloc(sizeof(struct juzfs_io) * iovcnt);
+    for (first = 0; first < iovcnt; first = last) {
+        last          = jfs_iovec_run(iov, first, iovcnt);
+        start_aligned = JFS_ROUND_DOWN(iov[first].offset, JFS_IO_SZ());
+        end           = JFS_ROUND_UP(iov[last - 1].offset + iov[last - 1].size, JFS_IO_SZ());
+
+        io[iocnt].offset   = start_aligned;
+        io[iocnt].size     = end - start_aligned;
+        io[iocnt].buf      = (uint8_t*)jfs_scratch_alloc(end - start_aligned);
+        io[iocnt].is_write = false;
+        iocnt++;
+    }
+
+    if (jfs_dev_submit(io, iocnt) != 0 || jfs_dev_wait() != 0) {
+        ret = -EIO;
+    }
+
+    for (first = 0, iocnt = 0; first < iovcnt; first = last, iocnt++) {
+        last = jfs_iovec_run(iov, first, iovcnt);
+        for (i = first; i < last && ret == 0; i++) {
+            memcpy(iov[i].buf, io[iocnt].buf + iov[i].offset - io[iocnt].offset, iov[i].size);
+        }
+    }
+    jfs_scratch_release(mark);
+    return ret;
+}
+
+/**
+ * @brief 向量写，iov按设备偏移排序后合并物理相邻的段，每段一次寻道和连续传输，
+ * 仅部分覆盖的首尾IO单位需要先读出；各段作为一批提交给后端
+ * 
+ * @param iov 写请求（会被重新排序）
+ * @param iovcnt 
+ * @return int 
+ */
+int jfs_driver_writev(struct juzfs_iovec* iov, int iovcnt) {
+    struct juzfs_arena_mark mark;
+    struct juzfs_io* io;
+    uint64_t start, end, start_aligned, end_aligned;
+    uint8_t* temp_content;
+    int      first, last, i;
+    int      iocnt = 0;
+    int      ret   = 0;
+
+    if (JFS_DEV_MAPPED()) {
+        for (i = 0; i < iovcnt; i++) {
+            jfs_driver_write(iov[i].offset, iov[i].buf, iov[i].size);
+        }
+        return 0;
+    }
+
+    qsort(iov, iovcnt, sizeof(struct juzfs_iovec), jfs_cmp_iovec);
+
+    if (jfs_cache_enabled()) {
+        for (i = 0; i < iovcnt; i++) {
+            if (jfs_driver_write(iov[i].offset, iov[i].buf, iov[i].size) != 0) {
+                return -EIO;
+            }
+        }
+        return 0;
+    }
+
+    mark = jfs_scratch_mark();
+    io   = (struct juzfs_io*)jfs_scratch_alloc(sizeof(struct juzfs_io) * iovcnt);
+    for (first = 0; first < iovcnt; first = last) {
+        last          = jfs_iovec_run(iov, first, iovcnt);
+        start         = iov[first].offset;
+        end           = iov[last - 1].offset + iov[last - 1].size;
+        start_aligned = JFS_ROUND_DOWN(start, JFS_IO_SZ());
+        end_aligned   = JFS_ROUND_UP(end, JFS_IO_SZ());
+
+        if (last - first == 1 && start == start_aligned && end == end_aligned) {
+            temp_content = NULL;                        /* 完整对齐，直接写调用者缓冲区 */
+        } else {
+            temp_content = (uint8_t*)jfs_scratch_alloc(end_aligned - start_aligned);
+            if ((start != start_aligned && 
+                 jfs_dev_read(start_aligned, temp_content, JFS_IO_SZ()) != 0) ||
+                (end != end_aligned && 
+                 (end_aligned - JFS_IO_SZ() != start_aligned || start == start_aligned) &&
+                 jfs_dev_read(end_aligned - JFS_IO_SZ(), 
+                              temp_content + end_aligned - start_aligned - JFS_IO_SZ(), JFS_IO_SZ()) != 0)) {
+                jfs_scratch_release(mark);
+                return -EIO;
+            }
+            for (i = first; i < last; i++) {
+                memcpy(temp_content + iov[i].offset - start_aligned, iov[i].buf, iov[i].size);
             }
-            ino_cursor++;
         }
-        if (is_find_free_entry) {
+
+        io[iocnt].offset   = start_aligned;
+        io[iocnt].size     = end_aligned - start_aligned;
+        io[iocnt].buf      = temp_content != NULL ? temp_content : iov[first].buf;
+        io[iocnt].is_write = true;
+        iocnt++;
+    }
+
+    if (jfs_dev_submit(io, iocnt) != 0 || jfs_dev_wait() != 0) {
+        ret = -EIO;
+    }
+
+    jfs_scratch_release(mark);
+    return ret;
+}
+
+/**
+ * @brief 将文件区间 [offset, offset + size) 映射为设备上的向量IO段，每个物理连续的区段一段
+ * 
+ * @param inode 
+ * @param buf 对应的内存缓冲区
+ * @param offset 文件内偏移
+ * @param size 
+ * @param iov 输出，至少 size / JFS_BLK_SZ() + 2 项
+ * @param is_write 读时落在空洞或预分配区段中的部分直接在buf中清零、不产生段；
+ *                 写时预分配的块照常映射，区间内不能有空洞，须先 jfs_file_fill_holes
+ * @return int 段数
+ */
+int jfs_file_iovec(struct juzfs_inode* inode, uint8_t* buf, off_t offset, size_t size, 
+                   struct juzfs_iovec* iov, bool is_write) {
+    int      iovcnt = 0;
+    off_t    pos;
+    int      bias;
+    int64_t  length;
+    int      run;
+    uint64_t pblk;
+
+    for (pos = offset; pos < offset + (off_t)size; pos += length) {
+        run = jfs_extent_map(inode, pos / JFS_BLK_SZ(), &pblk);
+        if (run <= 0) {
+            return -EIO;
+        }
+        bias   = pos % JFS_BLK_SZ();
+        length = (int64_t)run * JFS_BLK_SZ() - bias;
+        if (pos + length > offset + (off_t)size) {
+            length = offset + size - pos;
+        }
+        if (pblk == JFS_EXT_HOLE && is_write) {
+            return -EIO;
+        }
+        if (pblk == JFS_EXT_HOLE || (JFS_EXT_IS_UNWRITTEN(pblk) && !is_write)) {
+            memset(buf + (pos - offset), 0, length);
+            continue;
+        }
+        iov[iovcnt].offset = JFS_DATA_OFS(JFS_EXT_PBLK(pblk)) + bias;
+        iov[iovcnt].buf    = buf + (pos - offset);
+        iov[iovcnt].size   = length;
+        iovcnt++;
+    }
+    return iovcnt;
+}
+
+/**
+ * @brief 为文件块 [first, first + nblks) 中的空洞分配数据块，每段尽量紧接前一块连续分配
+ * 
+ * @param inode 
+ * @param first 
+ * @param nblks 
+ * @param unwritten 为真时作为预分配区段插入，读为零，写入后由 jfs_extent_convert 转为已写
+ * @return int64_t 自 first 起已连续映射的块数，空间不足时小于 nblks；一块都没分到时返回负错误码
+ */
+int64_t jfs_file_fill_holes(struct juzfs_inode* inode, uint64_t first, uint64_t nblks, bool unwritten) {
+    uint64_t i;
+    uint64_t pblk;
+    uint64_t prev;
+    int      run, got, want, start;
+    int      goal;
+
+    if (first + nblks > JFS_EXT_MAX_BLKS) {
+        return -EFBIG;
+    }
+    for (i = first; i < first + nblks; i += run) {
+        run = jfs_extent_map(inode, i, &pblk);
+        if (run <= 0) {
+            return i > first ? (int64_t)(i - first) : -EIO;
+        }
+        if (pblk != JFS_EXT_HOLE) {
+            continue;
+        }
+        want = first + nblks - i < (uint64_t)run ? first + nblks - i : run;
+        want = want < super.max_data_blks ? want : super.max_data_blks;
+        goal = -1;
+        if (i > 0 && jfs_extent_map(inode, i - 1, &prev) > 0 && prev != JFS_EXT_HOLE) {
+            goal = JFS_EXT_PBLK(prev) + 1;
+        }
+        start = jfs_alloc_data_blks(goal, want, &got);
+        if (start >= 0 && jfs_extent_insert(inode, i, unwritten ? start | JFS_EXT_UNWRITTEN : (uint64_t)start, 
+                                            got) != 0) {
+            jfs_dealloc_data_blks(start, got);
+            start = -ENOSPC;
+        }
+        if (start < 0) {
+            return i > first ? (int64_t)(i - first) : start;
+        }
+        run = got;
+    }
+    return nblks;
+}
+
+/**
+ * @brief 写文件数据：先为区间内的空洞分配数据块，新分配或预分配未写的首尾块中未被覆盖的部分写零，
+ * 与数据合并成一次向量写，写完后再把预分配的区段标为已写
+ * 
+ * @param inode 
+ * @param buf 
+ * @param offset 文件内偏移
+ * @param size 
+ * @return int 写入的字节数，空间不足时可能小于 size；出错返回负错误码
+ */
+int jfs_file_pwrite(struct juzfs_inode* inode, const uint8_t* buf, off_t offset, size_t size) {
+    struct juzfs_arena_mark mark;
+    struct juzfs_iovec*     iov;
+    uint8_t*                zero;
+    uint64_t first = offset / JFS_BLK_SZ();
+    uint64_t last;
+    uint64_t pblk;
+    int64_t  mapped;
+    bool     head_new, tail_new;
+    off_t    end;
+    int      iovcnt = 0;
+    int      n;
+
+    if (size == 0) {
+        return 0;
+    }
+    last     = (offset + size - 1) / JFS_BLK_SZ();
+    head_new = jfs_extent_map(inode, first, &pblk) > 0 && (pblk == JFS_EXT_HOLE || JFS_EXT_IS_UNWRITTEN(pblk));
+    tail_new = jfs_extent_map(inode, last, &pblk) > 0 && (pblk == JFS_EXT_HOLE || JFS_EXT_IS_UNWRITTEN(pblk));
+
+    mapped = jfs_file_fill_holes(inode, first, last - first + 1, false);
+    if (mapped < 0) {
+        return mapped;
+    }
+    if ((uint64_t)mapped < last - first + 1) {          /* 空间不足，只写已分配到的部分 */
+        size     = JFS_BLKS_SZ(first + mapped) - offset;
+        tail_new = false;
+    }
+    end = offset + size;
+
+    mark = jfs_scratch_mark();
+    zero = (uint8_t *)jfs_scratch_alloc(JFS_BLK_SZ());
+    iov  = (struct juzfs_iovec*)jfs_scratch_alloc(sizeof(struct juzfs_iovec) * (size / JFS_BLK_SZ() + 4));
+    memset(zero, 0, JFS_BLK_SZ());
+    if (head_new && offset % JFS_BLK_SZ() != 0) {
+        jfs_extent_map(inode, first, &pblk);
+        iov[iovcnt].offset = JFS_DATA_OFS(JFS_EXT_PBLK(pblk));
+        iov[iovcnt].buf    = zero;
+        iov[iovcnt].size   = offset % JFS_BLK_SZ();
+        iovcnt++;
+    }
+    n = jfs_file_iovec(inode, (uint8_t *)buf, offset, size, iov + iovcnt, true);
+    if (n < 0) {
+        jfs_scratch_release(mark);
+        return n;
+    }
+    iovcnt += n;
+    if (tail_new && end % JFS_BLK_SZ() != 0) {
+        jfs_extent_map(inode, last, &pblk);
+        iov[iovcnt].offset = JFS_DATA_OFS(JFS_EXT_PBLK(pblk)) + end % JFS_BLK_SZ();
+        iov[iovcnt].buf    = zero;
+        iov[iovcnt].size   = JFS_BLK_SZ() - end % JFS_BLK_SZ();
+        iovcnt++;
+    }
+    if (jfs_driver_writev(iov, iovcnt) != 0) {
+        jfs_scratch_release(mark);
+        return -EIO;
+    }
+    jfs_scratch_release(mark);
+
+    n = jfs_extent_convert(inode, first, (end - 1) / JFS_BLK_SZ() - first + 1);
+    return n != 0 ? n : (int)size;
+}
+
+static struct juzfs_file* jfs_file_free_list;
+
+/**
+ * @brief 分配打开文件的状态，释放的状态经空闲链表复用，稳态 open/release 不访问堆
+ * 
+ * @return struct juzfs_file* 
+ */
+struct juzfs_file* jfs_file_alloc(void) {
+    struct juzfs_file* file = jfs_file_free_list;
+
+    if (file != NULL) {
+        jfs_file_free_list = file->free_next;
+    } else {
+        file = (struct juzfs_file*)jfs_malloc(sizeof(struct juzfs_file));
+        if (file == NULL) {
+            return NULL;
+        }
+    }
+    memset(file, 0, sizeof(struct juzfs_file));
+    return file;
+}
+
+void jfs_file_free(struct juzfs_file* file) {
+    file->free_next    = jfs_file_free_list;
+    jfs_file_free_list = file;
+}
+
+/**
+ * @brief 顺序读检测与预读：连续命中上次读的结尾时窗口翻倍（至 JFS_RA_MAX_BLKS），
+ * 随机读时窗口归零；已预读的部分剩余不足半个窗口时异步预读下一窗口
+ * 
+ * @param file 打开文件的状态
+ * @param inode 
+ * @param offset 本次读的文件内偏移
+ * @param size 本次读的长度
+ */
+void jfs_file_readahead(struct juzfs_file* file, struct juzfs_inode* inode, off_t offset, size_t size) {
+    struct juzfs_arena_mark mark;
+    uint64_t* blknos;
+    uint64_t  pblk;
+    int       end_blk  = JFS_ROUND_UP(offset + (off_t)size, JFS_BLK_SZ()) / JFS_BLK_SZ();
+    int       file_blk = JFS_ROUND_UP(inode->size, JFS_BLK_SZ()) / JFS_BLK_SZ();
+    int       start, stop, i, run;
+
+    if (offset != file->next_ofs) {                    /* 随机读，窗口收缩 */
+        file->next_ofs  = offset + size;
+        file->ra_window = 0;
+        file->ra_end    = 0;
+        return;
+    }
+    file->next_ofs  = offset + size;
+    file->ra_window = file->ra_window == 0 ? JFS_RA_MIN_BLKS : file->ra_window * 2;
+    if (file->ra_window > JFS_RA_MAX_BLKS) {
+        file->ra_window = JFS_RA_MAX_BLKS;
+    }
+
+    if (file->ra_end < end_blk) {
+        file->ra_end = end_blk;
+    }
+    if (file->ra_end - end_blk >= file->ra_window / 2) {
+        return;
+    }
+
+    start = file->ra_end;
+    stop  = end_blk + file->ra_window < file_blk ? end_blk + file->ra_window : file_blk;
+    if (start >= stop) {
+        return;
+    }
+
+    mark   = jfs_scratch_mark();
+    blknos = (uint64_t*)jfs_scratch_alloc(sizeof(uint64_t) * (stop - start));
+    for (i = start; i < stop; i += run) {             /* 按区段展开为设备块号 */
+        run = jfs_extent_map(inode, i, &pblk);
+        if (run <= 0 || pblk == JFS_EXT_HOLE || JFS_EXT_IS_UNWRITTEN(pblk)) {   /* 读为零，无需预读 */
             break;
         }
+        run = run < stop - i ? run : stop - i;
+        for (int k = 0; k < run; k++) {
+            blknos[i - start + k] = JFS_DATA_OFS(pblk + k) / JFS_BLK_SZ();
+        }
+    }
+    stop = i < stop ? i : stop;
+    file->ra_end = start + jfs_cache_readahead(blknos, stop - start);
+    jfs_scratch_release(mark);
+}
+
+/**
+ * @brief 标记inode有改动，挂到 super.dirty_inodes 尾部，由后台回写、fsync 或 jfs_flush 写回；
+ * 链表因此按变脏先后排列，后台回写从头部取到未过期的为止
+ * 
+ * @param inode 
+ */
+void jfs_inode_mark_dirty(struct juzfs_inode* inode) {
+    if (inode->dirty) {
+        return;
+    }
+    inode->dirty       = true;
+    inode->dirtied_at  = jfs_now_ms();
+    inode->dirty_next  = NULL;
+    inode->dirty_pprev = super.dirty_tail;
+    *super.dirty_tail  = inode;
+    super.dirty_tail   = &inode->dirty_next;
+}
+
+/**
+ * @brief 从脏链表中摘除，inode已写回或即将释放
+ */
+static void jfs_inode_clean(struct juzfs_inode* inode) {
+    if (!inode->dirty) {
+        return;
+    }
+    *inode->dirty_pprev = inode->dirty_next;
+    if (inode->dirty_next != NULL) {
+        inode->dirty_next->dirty_pprev = inode->dirty_pprev;
+    } else {
+        super.dirty_tail = inode->dirty_pprev;
     }
+    inode->dirty = false;
+}
+
+/**
+ * @brief 平铺目录中第 idx 槽的项新增、删除或改了指向，该项及之后的目录项须重写
+ * 
+ * @param dir 
+ * @param idx 
+ */
+void jfs_dir_mark_dirty(struct juzfs_inode* dir, int idx) {
+    if (idx < dir->dir_dirty) {
+        dir->dir_dirty = idx;
+    }
+    jfs_inode_mark_dirty(dir);
+}
 
-    if (!is_find_free_entry || ino_cursor == super.max_ino)
+/**
+ * @brief 分配一个inode，占用位图
+ * 
+ * @param dentry 该dentry指向分配的inode
+ * @return sfs_inode
+ */
+struct juzfs_inode* jfs_alloc_inode(struct juzfs_dentry * dentry) {
+    struct juzfs_inode* inode;
+    int ino_cursor;
+                                                      /* 按64位字从next-fit游标查找 */
+    ino_cursor = jfs_bitmap_alloc(&super.ino_bm);
+    if (ino_cursor < 0)
         return (void*)-ENOSPC;
 
-    inode = (struct juzfs_inode*)malloc(sizeof(struct juzfs_inode));
+    inode_cnt++;
+    printf("allocated inode %s\n",dentry->name);
+
+    inode = (struct juzfs_inode*)jfs_malloc(sizeof(struct juzfs_inode));
     inode->ino  = ino_cursor; 
     inode->size = 0;
                                                       /* dentry指向inode */
@@ -254,65 +946,192 @@ struct juzfs_inode* jfs_alloc_inode(struct juzfs_dentry * dentry) {
     inode->dentry = dentry;
     
     inode->dir_cnt = 0;
+    inode->dir_loaded = 0;
+    inode->dir_holes = 0;
+    inode->dir_seq = 0;
+    inode->dir_rd_ofs = 0;
     inode->dentrys = NULL;
     inode->dentrys_list_size = 0;
-    
-    memset(inode->data_offsets, 0, sizeof(uint64_t)*JFS_DATA_PER_FILE);
+    inode->dtab    = NULL;
+    inode->dtab_size = 0;
+                                                      /* 新文件从内联开始，放不下时再转为数据块；新目录使用变长目录项 */
+    inode->flags       = dentry->ftype == FILE_TYPE ? JFS_INODE_INLINE : JFS_INODE_DIRENT_VAR;
+    inode->inline_data = NULL;
+    inode->dirty       = false;
+    inode->dir_dirty   = JFS_DIR_CLEAN;
+    jfs_extent_init(inode);
+    jfs_inode_mark_dirty(inode);
 
     return inode;
 }
 
 /**
- * @brief 将内存inode及其下方结构全部刷回磁盘
+ * @brief 把完整读入的旧格式目录改为变长目录项：size 记为目录项总字节数，
+ * 释放多出的目录块（变长项不比定长项长，块数只会减少）
+ * 
+ * @param inode 目录inode，须完整在内存中
+ */
+static void jfs_dirent_convert(struct juzfs_inode* inode) {
+    if (JFS_IS_DIRENT_VAR(inode)) {
+        return;
+    }
+    inode->size = 0;
+    for (int i = 0; i < inode->dir_loaded; i++) {
+        if (inode->dentrys[i] != NULL) {
+            inode->size += JFS_DIRENT_LEN(strlen(inode->dentrys[i]->name));
+        }
+    }
+    inode->flags |= JFS_INODE_DIRENT_VAR;
+    jfs_extent_truncate(inode, JFS_ROUND_UP(inode->size, JFS_BLK_SZ()) / JFS_BLK_SZ());
+    jfs_dir_mark_dirty(inode, 0);
+}
+
+/**
+ * @brief 把一个内存inode写回磁盘：inode本身，以及平铺目录中自 dir_dirty 所在块起的目录块；
+ * 不递归到子项，子项各自挂在脏链表上。成功后inode从脏链表摘除
  * 
  * @param inode 
  * @return int 
  */
 int jfs_sync_inode(struct juzfs_inode * inode) {
-    struct juzfs_inode_d  inode_d;
-    struct juzfs_dentry_d*  dentrys_d;
-    // struct juzfs_dentry_d dentry_d;
-    uint64_t offset;
-    size_t dentrys_d_size;
+    struct juzfs_inode_d* inode_d;
+    size_t inode_d_size = sizeof(struct juzfs_inode_d);
+    struct juzfs_dirent_d*  dirent_d;
+    uint8_t*              dirents_d;
+    struct juzfs_iovec*   iov;
+    int iovcnt          = 0;
+    uint64_t dirent_ofs = 0;
+    uint64_t dirty_ofs;
     int ino             = inode->ino;
     int blk_cursor      = 0;
+    int nblks           = 0;
+    int ret             = 0;
+    bool write_dir;
+    uint64_t pblk;
+    struct juzfs_arena_mark mark = jfs_scratch_mark();
+
+    if (JFS_IS_DIR(inode) && !JFS_IS_DTREE(inode) && JFS_DIR_COMPLETE(inode)) {   /* 旧格式的目录在此改写为变长目录项 */
+        jfs_dirent_convert(inode);
+    }
+    write_dir = JFS_IS_DIR(inode) && !JFS_IS_DTREE(inode) &&        /* B+树已直接写出 */
+                inode->dir_dirty != JFS_DIR_CLEAN && JFS_DIR_COMPLETE(inode);
+    if (write_dir) {
+        nblks = JFS_ROUND_UP(inode->size, JFS_BLK_SZ()) / JFS_BLK_SZ();
+    }
+    iov = (struct juzfs_iovec*)jfs_scratch_alloc(sizeof(struct juzfs_iovec) * (nblks + 1));
 
-    inode_d.ino         = ino;
-    inode_d.size        = inode->size;
-    inode_d.ftype       = inode->dentry->ftype;
-    inode_d.dir_cnt     = inode->dir_cnt;
-    memcpy(inode_d.data_offsets,inode->data_offsets,JFS_INODE_DATA_OFS_ARRAY_SIZE());
-    
-    if (jfs_driver_write(JFS_INO_OFS(ino), (uint8_t *)&inode_d, 
-                     sizeof(struct juzfs_inode_d)) != 0) {
-        return -EIO;
+    if (JFS_IS_INLINE(inode) && inode->size > 0) {      /* 内联内容随inode写出，补齐IO单位免去先读 */
+        inode_d_size = JFS_ROUND_UP(sizeof(struct juzfs_inode_d) + inode->size, JFS_IO_SZ());
+        inode_d_size = inode_d_size < JFS_INODE_SZ() ? inode_d_size : JFS_INODE_SZ();
     }
 
-    if (JFS_IS_DIR(inode)) {
+    inode_d = (struct juzfs_inode_d *)jfs_dev_ptr(JFS_INO_OFS(ino));
+    if (inode_d == NULL) {                              /* 未映射时经驱动写回 */
+        inode_d = (struct juzfs_inode_d *)jfs_scratch_alloc(inode_d_size);
+        memset(inode_d, 0, inode_d_size);
+        iov[iovcnt].offset  = JFS_INO_OFS(ino);
+        iov[iovcnt].buf     = (uint8_t *)inode_d;
+        iov[iovcnt].size    = inode_d_size;
+        iovcnt++;
+    }
+
+    inode_d->ino        = ino;
+    inode_d->size       = inode->size;
+    inode_d->ftype      = inode->dentry->ftype;
+    inode_d->dir_cnt    = inode->dir_cnt;
+    inode_d->flags      = inode->flags;
+    inode_d->ext_root   = inode->ext_root;
+    if (JFS_IS_INLINE(inode) && inode->size > 0) {
+        memcpy((uint8_t *)(inode_d + 1), inode->inline_data, inode->size);
+    }
+
+    if (write_dir) {                                    /* 平铺目录不超过几块，整体排好后只写脏的部分 */
+        dirents_d = (uint8_t *)jfs_scratch_alloc(JFS_BLKS_SZ(nblks));
+        dirty_ofs = inode->size;
 
-        dentrys_d_size  = sizeof(struct juzfs_dentry_d)*inode->dir_cnt;
-        dentrys_d       = (struct juzfs_dentry_d*)malloc(dentrys_d_size);
+        for (int i=0; i < inode->dir_loaded; i++) {   /* 跳过空槽，磁盘上连续存放 */
+            if (inode->dentrys[i] == NULL) {
+                continue;
+            }
+            if (i >= inode->dir_dirty && dirty_ofs == inode->size) {
+                dirty_ofs = dirent_ofs;
+            }
+            dirent_d           = (struct juzfs_dirent_d *)(dirents_d + dirent_ofs);
+            dirent_d->ino      = inode->dentrys[i]->ino;
+            dirent_d->ftype    = inode->dentrys[i]->ftype;
+            dirent_d->name_len = strlen(inode->dentrys[i]->name);
+            dirent_d->rec_len  = JFS_DIRENT_LEN(dirent_d->name_len);
+            memset(dirent_d->name, 0, dirent_d->rec_len - sizeof(struct juzfs_dirent_d));
+            memcpy(dirent_d->name, inode->dentrys[i]->name, dirent_d->name_len);
+            dirent_ofs        += dirent_d->rec_len;
+        }
 
-        for (int i=0; i < inode->dir_cnt; i++) {
-            memcpy(dentrys_d[i].name, inode->dentrys[i].name, sizeof(char)*MAX_NAME_LEN);
-            dentrys_d[i].ino = inode->dentrys[i].ino;
-            dentrys_d[i].ftype = inode->dentrys[i].ftype;
-            if (inode->dentrys[i].inode != NULL) {
-                jfs_sync_inode(inode->dentrys[i].inode);
+        for (blk_cursor = dirty_ofs / JFS_BLK_SZ(); blk_cursor < nblks; blk_cursor++) {
+            if (jfs_extent_map(inode, blk_cursor, &pblk) <= 0 || pblk == JFS_EXT_HOLE) {
+                jfs_scratch_release(mark);
+                return -EIO;
             }
+            iov[iovcnt].offset = JFS_DATA_OFS(pblk);
+            iov[iovcnt].buf    = dirents_d + JFS_BLKS_SZ(blk_cursor);
+            iov[iovcnt].size   = blk_cursor == nblks - 1 ? inode->size - JFS_BLKS_SZ(blk_cursor) : JFS_BLK_SZ();
+            iovcnt++;
         }
+    }
+
+    if (jfs_driver_writev(iov, iovcnt) != 0) {           /* inode与目录项一次提交 */
+        ret = -EIO;
+    } else {
+        if (write_dir) {
+            inode->dir_dirty = JFS_DIR_CLEAN;
+        }
+        jfs_inode_clean(inode);
+    }
+    jfs_scratch_release(mark);
+    
+    return ret;
+}
 
-        for (blk_cursor = 0; blk_cursor < inode->dir_cnt / JFS_DENTRYS_SEG_SIZE(); blk_cursor++) {              
-            offset= JFS_DATA_OFS(inode->data_offsets[blk_cursor]);
+/**
+ * @brief 区段树之前的inode：文件按 size、目录按 dir_cnt 计有效块数，物理连续的块号
+ * 合并为一个区段建成区段树。inode记为脏，写回后即为新格式
+ * 
+ * @param inode 除映射外的字段已初始化
+ * @param legacy_d 
+ * @return int 块号越界时为 -EIO，建树失败时为其错误码
+ */
+static int jfs_read_inode_legacy(struct juzfs_inode* inode, const struct juzfs_inode_legacy_d* legacy_d) {
+    int nblks, run, i;
+    int ret = 0;
 
-            if (jfs_driver_write(offset, (uint8_t *)&dentrys_d[blk_cursor * JFS_DENTRYS_SEG_SIZE()], JFS_DENTRYS_SEG_SIZE()*sizeof(struct juzfs_dentry_d)) != 0) {
-                return -EIO;                     
-            }
+    if (legacy_d->size < 0 || legacy_d->dir_cnt < 0) {
+        return -EIO;
+    }
+    nblks = JFS_IS_DIR(inode) ? JFS_ROUND_UP(legacy_d->dir_cnt, (int)JFS_DENTRYS_SEG_SIZE()) / JFS_DENTRYS_SEG_SIZE()
+                              : JFS_ROUND_UP(legacy_d->size, JFS_BLK_SZ()) / JFS_BLK_SZ();
+    if (nblks > JFS_DATA_PER_FILE) {
+        return -EIO;
+    }
+    for (i = 0; i < nblks; i++) {
+        if (legacy_d->data_offsets[i] >= (uint64_t)super.max_data_blks) {
+            return -EIO;
         }
+    }
 
-        free(dentrys_d);
+    inode->ino     = legacy_d->ino;
+    inode->size    = legacy_d->size;
+    inode->dir_cnt = legacy_d->dir_cnt;
+    inode->flags   = 0;                               /* 数据块存放，目录为定长目录项 */
+    jfs_extent_init(inode);
+    for (i = 0; ret == 0 && i < nblks; i += run) {
+        for (run = 1; i + run < nblks && legacy_d->data_offsets[i + run] == legacy_d->data_offsets[i] + run; run++)
+            ;
+        ret = jfs_extent_insert(inode, i, legacy_d->data_offsets[i], run);
     }
-    
+    if (ret != 0) {
+        jfs_inode_clean(inode);
+        return ret;
+    }
+    jfs_inode_mark_dirty(inode);
     return 0;
 }
 
@@ -324,143 +1143,430 @@ int jfs_sync_inode(struct juzfs_inode * inode) {
  * @return struct sfs_inode* 
  */
 struct juzfs_inode* jfs_read_inode(struct juzfs_dentry * dentry, int ino) {
-    struct juzfs_inode*     inode = (struct juzfs_inode*)malloc(sizeof(struct juzfs_inode));
-    struct juzfs_inode_d    inode_d;
-    struct juzfs_dentry*    sub_dentry;
-    // struct juzfs_dentry_d dentry_d;
-    struct juzfs_dentry_d*  dentrys_d;
-    uint64_t                offset;
-    size_t                  dentrys_d_size;
-    int                     blk_cursor;
+    struct juzfs_inode*     inode = (struct juzfs_inode*)jfs_malloc(sizeof(struct juzfs_inode));
+    struct juzfs_inode_d*   inode_d;
+    size_t                  inode_d_size;
+    bool                    is_legacy;
+    struct juzfs_arena_mark mark = jfs_scratch_mark();
     // int    dir_cnt = 0, i;
-    if (jfs_driver_read(JFS_INO_OFS(ino), (uint8_t *)&inode_d, sizeof(struct juzfs_inode_d)) != 0) {
+    inode_d = (struct juzfs_inode_d *)jfs_dev_ptr(JFS_INO_OFS(ino));
+    if (inode_d == NULL) {                            /* 文件读入整个槽，内联内容无需再访问设备 */
+        inode_d_size = dentry->ftype == FILE_TYPE ? JFS_INODE_SZ() : sizeof(struct juzfs_inode_d);
+        inode_d      = (struct juzfs_inode_d *)jfs_scratch_alloc(inode_d_size);
+        if (jfs_driver_read(JFS_INO_OFS(ino), (uint8_t *)inode_d, inode_d_size) != 0) {
+            jfs_scratch_release(mark);
+            free(inode);
+            return NULL;
+        }
+    }
+                                                      /* 区段树之前的inode：根的max处是块号高位，总为0 */
+    is_legacy = super.layout_version == JFS_LAYOUT_LEGACY && 
+                (inode_d->ext_root.eh.magic != JFS_EXT_MAGIC || inode_d->ext_root.eh.max != JFS_EXT_ROOT_CNT);
+    if (!is_legacy && (inode_d->ext_root.eh.magic != JFS_EXT_MAGIC ||            /* 损坏的inode */
+                       ((inode_d->flags & JFS_INODE_INLINE) && inode_d->size > JFS_INLINE_MAX()))) {
+        jfs_scratch_release(mark);
+        free(inode);
         return NULL;
     }
-    inode->ino      = inode_d.ino;
-    inode->size     = inode_d.size;
-    inode->dir_cnt  = 0;
+    inode->ino      = inode_d->ino;
+    inode->size     = inode_d->size;
+    inode->dir_cnt  = inode_d->dir_cnt;
+    inode->dir_loaded = 0;                          /* 目录项到查找或readdir用到时才读入 */
+    inode->dir_holes = 0;
+    inode->dir_seq  = 0;
+    inode->dir_rd_ofs = 0;
     inode->dentry   = dentry;
     inode->dentrys  = NULL;
     inode->dentrys_list_size = 0;
-    memcpy(inode->data_offsets, inode_d.data_offsets, JFS_INODE_DATA_OFS_ARRAY_SIZE());
+    inode->dtab     = NULL;
+    inode->dtab_size = 0;
+    inode->ext_root = inode_d->ext_root;
+    inode->ext_last.len = 0;
+    inode->flags    = inode_d->flags;
+    inode->inline_data = NULL;
+    inode->dirty    = false;
+    inode->dir_dirty = JFS_DIR_CLEAN;
+    if (is_legacy && jfs_read_inode_legacy(inode, (struct juzfs_inode_legacy_d *)inode_d) != 0) {
+        jfs_scratch_release(mark);
+        free(inode);
+        return NULL;
+    }
+    if (JFS_IS_INLINE(inode) && inode->size > 0) {
+        inode->inline_data = (uint8_t *)jfs_malloc(JFS_INLINE_MAX());
+        memcpy(inode->inline_data, (uint8_t *)(inode_d + 1), inode->size);
+    }
 
-    if (JFS_IS_DIR(inode)) {
-        inode->dir_cnt  = inode_d.dir_cnt;
-        dentrys_d_size  = sizeof(struct juzfs_dentry)*inode->dir_cnt;
-        dentrys_d       = (struct juzfs_dentry_d*)malloc(dentrys_d_size);
+    jfs_scratch_release(mark);
+    return inode;
+}
 
-        for (blk_cursor = 0; blk_cursor < inode->dir_cnt / JFS_DENTRYS_SEG_SIZE(); blk_cursor++){            
-            offset = JFS_DATA_OFS(inode->data_offsets[blk_cursor]);
+/**
+ * @brief 旧格式目录：每块 JFS_DENTRYS_SEG_SIZE() 个定长目录项，按块读入
+ */
+static int jfs_read_dentrys_fixed(struct juzfs_inode* inode, int cnt) {
+    struct juzfs_dentry*    sub_dentry;
+    struct juzfs_dentry_d*  dentrys_d;
+    struct juzfs_iovec*     iov;
+    int                     first, last, blk_cursor, seg_cnt;
+    int                     ret = 0;
+    uint64_t                pblk;
+    struct juzfs_arena_mark mark;
+
+    mark      = jfs_scratch_mark();
+    first     = inode->dir_loaded / JFS_DENTRYS_SEG_SIZE();     /* 已读入的部分总是整块 */
+    last      = (cnt - 1) / JFS_DENTRYS_SEG_SIZE();
+    dentrys_d = (struct juzfs_dentry_d*)jfs_scratch_alloc(JFS_BLKS_SZ(last - first + 1));
+    iov       = (struct juzfs_iovec*)jfs_scratch_alloc(sizeof(struct juzfs_iovec) * (last - first + 1));
+
+    for (blk_cursor = first; blk_cursor <= last; blk_cursor++) {
+        seg_cnt = inode->dir_cnt - blk_cursor * JFS_DENTRYS_SEG_SIZE();
+        seg_cnt = seg_cnt < JFS_DENTRYS_SEG_SIZE() ? seg_cnt : JFS_DENTRYS_SEG_SIZE();
+
+        if (jfs_extent_map(inode, blk_cursor, &pblk) <= 0 || pblk == JFS_EXT_HOLE) {
+            jfs_scratch_release(mark);
+            return -EIO;
+        }
+        iov[blk_cursor - first].offset = JFS_DATA_OFS(pblk);
+        iov[blk_cursor - first].buf    = (uint8_t *)&dentrys_d[(blk_cursor - first) * JFS_DENTRYS_SEG_SIZE()];
+        iov[blk_cursor - first].size   = seg_cnt*sizeof(struct juzfs_dentry_d);
+    }
 
-            if (jfs_driver_read(offset, (uint8_t *)&dentrys_d[blk_cursor * JFS_DENTRYS_SEG_SIZE()], JFS_DENTRYS_SEG_SIZE()*sizeof(struct juzfs_dentry_d)) != 0){
-                return NULL;
+    if (jfs_driver_readv(iov, last - first + 1) != 0) {
+        jfs_scratch_release(mark);
+        return -EIO;
+    }
+
+    seg_cnt = inode->dir_cnt < (last + 1) * JFS_DENTRYS_SEG_SIZE() ? inode->dir_cnt : (last + 1) * JFS_DENTRYS_SEG_SIZE();
+    for (int i = inode->dir_loaded; i < seg_cnt; i++) {
+        sub_dentry = new_dentry(dentrys_d[i - first * JFS_DENTRYS_SEG_SIZE()].name, inode->dentry,
+                                dentrys_d[i - first * JFS_DENTRYS_SEG_SIZE()].ftype);
+        sub_dentry->ino = dentrys_d[i - first * JFS_DENTRYS_SEG_SIZE()].ino;
+        if (jfs_alloc_dentry(inode, sub_dentry, false) < 0) {
+            free(sub_dentry);
+            ret = -ENOMEM;
+            break;
+        }
+    }
+    jfs_scratch_release(mark);
+    return ret;
+}
+
+/**
+ * @brief 变长目录项：目录项可跨块存放，按平均项长估计要读的块数，
+ * 只解析完整落在已读范围内的项，下次从 dir_rd_ofs 接着读
+ */
+static int jfs_read_dirents(struct juzfs_inode* inode, int cnt) {
+    struct juzfs_dentry*    sub_dentry;
+    struct juzfs_dirent_d*  dirent_d;
+    struct juzfs_iovec*     iov;
+    uint8_t*                dirents_d;
+    char                    name[MAX_NAME_LEN];
+    int                     first, last, blk_cursor;
+    int                     ret = 0;
+    uint64_t                pblk, ofs, end;
+    struct juzfs_arena_mark mark;
+
+    while (ret == 0 && inode->dir_loaded < cnt) {
+        mark  = jfs_scratch_mark();
+        end   = inode->dir_rd_ofs + (cnt - inode->dir_loaded) * (inode->size / inode->dir_cnt) + JFS_DIRENT_MAX_LEN;
+        end   = end < inode->size ? end : inode->size;
+        first = inode->dir_rd_ofs / JFS_BLK_SZ();
+        last  = (end - 1) / JFS_BLK_SZ();
+        dirents_d = (uint8_t *)jfs_scratch_alloc(JFS_BLKS_SZ(last - first + 1));
+        iov       = (struct juzfs_iovec*)jfs_scratch_alloc(sizeof(struct juzfs_iovec) * (last - first + 1));
+
+        end = JFS_BLKS_SZ((uint64_t)last + 1) < inode->size ? JFS_BLKS_SZ((uint64_t)last + 1) : inode->size;
+        for (blk_cursor = first; blk_cursor <= last; blk_cursor++) {
+            if (jfs_extent_map(inode, blk_cursor, &pblk) <= 0 || pblk == JFS_EXT_HOLE) {
+                jfs_scratch_release(mark);
+                return -EIO;
+            }
+            iov[blk_cursor - first].offset = JFS_DATA_OFS(pblk);
+            iov[blk_cursor - first].buf    = dirents_d + JFS_BLKS_SZ(blk_cursor - first);
+            iov[blk_cursor - first].size   = blk_cursor == last ? end - JFS_BLKS_SZ((uint64_t)last) : JFS_BLK_SZ();
+        }
+        if (jfs_driver_readv(iov, last - first + 1) != 0) {
+            jfs_scratch_release(mark);
+            return -EIO;
+        }
+
+        ret = -EIO;                                 /* 一项也解析不出说明目录块已损坏 */
+        for (ofs = inode->dir_rd_ofs; inode->dir_loaded < inode->dir_cnt &&
+             ofs + sizeof(struct juzfs_dirent_d) <= end; ofs += dirent_d->rec_len) {
+            dirent_d = (struct juzfs_dirent_d *)(dirents_d + ofs - JFS_BLKS_SZ((uint64_t)first));
+            if (ofs + dirent_d->rec_len > end) {
+                break;                              /* 跨出已读范围，下次再读 */
+            }
+            if (dirent_d->name_len >= MAX_NAME_LEN || dirent_d->rec_len != JFS_DIRENT_LEN(dirent_d->name_len)) {
+                ret = -EIO;
+                break;
+            }
+            memcpy(name, dirent_d->name, dirent_d->name_len);
+            name[dirent_d->name_len] = '\0';
+            sub_dentry      = new_dentry(name, inode->dentry, dirent_d->ftype);
+            sub_dentry->ino = dirent_d->ino;
+            if (jfs_alloc_dentry(inode, sub_dentry, false) < 0) {
+                free(sub_dentry);
+                ret = -ENOMEM;
+                break;
             }
+            inode->dir_rd_ofs = ofs + dirent_d->rec_len;
+            ret = 0;
         }
+        jfs_scratch_release(mark);
+    }
+    return ret;
+}
 
-        for (int i = 0; i < inode_d.dir_cnt; i++)
-        {
-            //copy dentrys
-            sub_dentry = new_dentry(dentrys_d[i].name, inode->dentry, dentrys_d->ftype);
+/**
+ * @brief B+树目录：内存中只有查找过的子项，按键序遍历整棵树补齐其余的
+ */
+static int jfs_read_dtree(struct juzfs_inode* inode) {
+    struct juzfs_dtree_ent* ents;
+    struct juzfs_dentry*    sub_dentry;
+    struct juzfs_arena_mark mark = jfs_scratch_mark();
+    uint64_t                cookie = 0;
+    int                     n = 0, ret = 0;
+
+    ents = (struct juzfs_dtree_ent*)jfs_scratch_alloc(sizeof(struct juzfs_dtree_ent) * JFS_DTREE_SCAN_BATCH);
+    while (ret == 0 && (n = jfs_dtree_scan(inode, cookie, ents, JFS_DTREE_SCAN_BATCH)) > 0) {
+        for (int i = 0; i < n; i++) {
+            if (jfs_dir_find(inode, ents[i].name) != NULL) {
+                continue;
+            }
+            sub_dentry      = new_dentry(ents[i].name, inode->dentry, ents[i].ftype);
+            sub_dentry->ino = ents[i].ino;
+            if (jfs_alloc_dentry(inode, sub_dentry, false) < 0) {
+                free(sub_dentry);
+                ret = -ENOMEM;
+                break;
+            }
+        }
+        cookie = ents[n - 1].key;
+    }
+    jfs_scratch_release(mark);
+    return ret != 0 ? ret : n;
+}
 
-            sub_dentry->ino = dentrys_d[i].ino;
+/**
+ * @brief 按磁盘上的顺序继续读入目录块，直到至少 cnt 个目录项在内存中
+ * 
+ * @param inode 目录inode
+ * @param cnt 需要的目录项数，超过 dir_cnt 时读完整个目录
+ * @return int 
+ */
+int jfs_read_dentrys(struct juzfs_inode* inode, int cnt) {
+    cnt = cnt < inode->dir_cnt ? cnt : inode->dir_cnt;
+    if (inode->dir_loaded - inode->dir_holes >= cnt) {
+        return 0;
+    }
+    if (JFS_IS_DTREE(inode)) {                      /* B+树没有先后，只能全部读入 */
+        return jfs_read_dtree(inode);
+    }
+    return JFS_IS_DIRENT_VAR(inode) ? jfs_read_dirents(inode, cnt) : jfs_read_dentrys_fixed(inode, cnt);
+}
 
-            jfs_alloc_dentry(inode, sub_dentry,false);
+/**
+ * @brief 在目录中按名字查找子项，内存中没有时继续读入目录块，
+ * 每次读入的块数翻倍，找不到的名字也只需 O(log n) 次设备读；B+树目录自根向下查一条路径
+ * 
+ * @param inode 目录inode
+ * @param name 
+ * @return struct juzfs_dentry* 未找到时返回NULL
+ */
+struct juzfs_dentry* jfs_find_dentry(struct juzfs_inode* inode, const char* name) {
+    struct juzfs_dentry*   dentry = jfs_dir_find(inode, name);
+    struct juzfs_dtree_ent ent;
+    int                    more;
+
+    if (JFS_IS_DTREE(inode)) {                      /* B+树只读入查到的这一项 */
+        if (dentry != NULL || jfs_dtree_lookup(inode, name, &ent) != 0) {
+            return dentry;
         }
+        dentry      = new_dentry(ent.name, inode->dentry, ent.ftype);
+        dentry->ino = ent.ino;
+        if (jfs_alloc_dentry(inode, dentry, false) < 0) {
+            free(dentry);
+            return NULL;
+        }
+        return dentry;
+    }
 
-        free(dentrys_d);
+    while (dentry == NULL && !JFS_DIR_COMPLETE(inode)) {
+        more = inode->dir_loaded > JFS_DENTRYS_SEG_SIZE() ? inode->dir_loaded : JFS_DENTRYS_SEG_SIZE();
+        if (jfs_read_dentrys(inode, inode->dir_loaded + more) != 0) {
+            return NULL;
+        }
+        dentry = jfs_dir_find(inode, name);
     }
-    return inode;
+    return dentry;
 }
 
 /**
- * @brief 为一个inode分配子dentry，数组不足时扩展数组
+ * @brief 为一个inode加入子dentry，目录项写满一个目录块时再分配下一块
  * 
  * @param inode 
- * @param dentry 
- * @return int 
+ * @param dentry 由 new_dentry 分配，加入后归目录所有
+ * @param alloc_d 是否需要分配目录块（从磁盘读入时不需要）
+ * @return int 目录项数，失败时返回负的错误码
  */
 int jfs_alloc_dentry(struct juzfs_inode* inode, struct juzfs_dentry* dentry, bool alloc_d)
 {
-    struct juzfs_dentry* old_dentrys;
-    int new_list_size;
-
-    // 空间不足
-    if (inode->dentrys_list_size < inode->dir_cnt+1) {
-
-        old_dentrys = inode->dentrys;
-
-        new_list_size = JFS_ROUND_UP(inode->dir_cnt+1,JFS_DENTRYS_SEG_SIZE());
-
-        // 目录超过六块
-        if (new_list_size / JFS_DENTRYS_SEG_SIZE() > JFS_DATA_PER_FILE) return -ENOSPC;
-
-        if (alloc_d)
-            inode->data_offsets[new_list_size / JFS_DENTRYS_SEG_SIZE() - 1] = jfs_alloc_data_blk();
-
-        inode->dentrys = (struct juzfs_dentry*)malloc(sizeof(struct juzfs_dentry) * new_list_size);
+    int blk, nblks, len, ret;
 
-        if (old_dentrys != NULL) {
-            // 非空目录
-            memcpy(inode->dentrys, old_dentrys, sizeof(struct juzfs_dentry)*inode->dir_cnt);
-            free(old_dentrys);
+    if (!alloc_d) {                                 /* 从磁盘读入，只登记到内存中的目录 */
+        return jfs_dir_add(inode, dentry) != 0 ? -ENOMEM : inode->dir_loaded;
+    }
+    if (JFS_IS_DTREE(inode)) {                      /* 直接插入B+树，不必读入其余子项 */
+        ret = jfs_dtree_insert(inode, dentry->name, dentry->ino, dentry->ftype);
+        if (ret != 0) {
+            return ret;
         }
-
-        inode->dentrys_list_size = new_list_size;
+        if (jfs_dir_add(inode, dentry) != 0) {
+            jfs_dtree_delete(inode, dentry->name);
+            return -ENOMEM;
+        }
+        jfs_inode_mark_dirty(inode);
+        return ++inode->dir_cnt;
+    }
+    if (jfs_read_dentrys(inode, inode->dir_cnt) != 0) {     /* 新项追加在末尾，目录须完整在内存中 */
+        return -EIO;
     }
+    jfs_dirent_convert(inode);
 
-    memcpy(&(inode->dentrys[inode->dir_cnt]),dentry,sizeof(struct juzfs_dentry));
+    len   = JFS_DIRENT_LEN(strlen(dentry->name));
+    nblks = JFS_ROUND_UP(inode->size, JFS_BLK_SZ()) / JFS_BLK_SZ();
+    if (inode->size + len > JFS_BLKS_SZ((uint64_t)JFS_DIR_FLAT_MAX_BLKS)) {  /* 平铺目录过大，转为B+树 */
+        ret = jfs_dtree_build(inode);
+        return ret != 0 ? ret : jfs_alloc_dentry(inode, dentry, true);
+    }
+    if (inode->size + len > JFS_BLKS_SZ((uint64_t)nblks)) { /* 目录块追加到区段树末尾 */
+        blk = jfs_alloc_data_blk();
+        if (blk < 0) return -ENOSPC;
+        if (jfs_extent_insert(inode, nblks, blk, 1) != 0) {
+            jfs_dealloc_data_blk(blk);
+            return -ENOSPC;
+        }
+    }
 
-    inode->dir_cnt++;
+    if (jfs_dir_add(inode, dentry) != 0) {
+        jfs_extent_truncate(inode, nblks);
+        return -ENOMEM;
+    }
+    jfs_dir_mark_dirty(inode, dentry->idx);
 
-    return inode->dir_cnt;
+    inode->size += len;
+    return ++inode->dir_cnt;
 } 
 
 /**
  * @brief 分配一个数据块
  * 
- * @return uint64_t 数据块 offset
+ * @return int 数据块号，已满时返回 -ENOSPC
  */
-uint64_t  jfs_alloc_data_blk(void)
+int  jfs_alloc_data_blk(void)
 {
-    int byte_cursor = 0; 
-    int bit_cursor  = 0; 
-    int blk_cursor  = 0;
-    bool is_find_free_entry = false;
-
-    for (byte_cursor = 0; byte_cursor < JFS_BLKS_SZ(super.map_data_blks); 
-         byte_cursor++)
-    {
-        for (bit_cursor = 0; bit_cursor < UINT8_BITS; bit_cursor++) {
-            if((super.map_data[byte_cursor] & (0x1 << bit_cursor)) == 0) {    
-                /* 当前blk_cursor位置空闲 */
-                super.map_data[byte_cursor] |= (0x1 << bit_cursor);
-                is_find_free_entry = true;           
-                break;
-            }
-            blk_cursor++;
-        }
-        if (is_find_free_entry) {
-            break;
-        }
-    }
+    int blk_cursor;
 
-    if (!is_find_free_entry || blk_cursor == super.max_data_blks)
+    blk_cursor = jfs_bitmap_alloc(&super.data_bm);    /* 已满时由空闲计数直接判定 */
+    if (blk_cursor < 0)
         return -ENOSPC;
 
+    super.sz_usage += JFS_BLK_SZ();
     return blk_cursor;
 }
 
 /**
- * @brief 释放一个数据块
+ * @brief 分配物理连续的若干数据块，没有足够长的空闲段时返回能找到的最长段
+ * 
+ * @param goal 期望的起始块（如文件最后一块之后），小于0表示不限
+ * @param want 期望块数
+ * @param got 输出，实际分配的块数
+ * @return int 起始块号，已满时返回 -ENOSPC
+ */
+int jfs_alloc_data_blks(int goal, int want, int* got)
+{
+    int blk_start = jfs_bitmap_alloc_run(&super.data_bm, goal, want, got);
+
+    if (blk_start < 0)
+        return -ENOSPC;
+
+    super.sz_usage += JFS_BLKS_SZ((uint64_t)*got);
+    return blk_start;
+}
+
+/**
+ * @brief 释放一个数据块，游标指向刚释放的块，下次分配直接复用
  * 
  * @return int
  */
 int  jfs_dealloc_data_blk(int blk_num) {
-    int byte_cursor = blk_num / UINT8_BITS; 
-    int bit_cursor  = blk_num % UINT8_BITS;
+    jfs_bitmap_free(&super.data_bm, blk_num);
+    super.sz_usage -= JFS_BLK_SZ();
+
+    return 0;
+}
+
+/**
+ * @brief 释放 [start, start + cnt) 的数据块
+ * 
+ * @param start 
+ * @param cnt 
+ */
+void jfs_dealloc_data_blks(uint64_t start, uint32_t cnt) {
+    for (uint32_t i = 0; i < cnt; i++) {
+        jfs_bitmap_free(&super.data_bm, start + i);
+    }
+    super.sz_usage -= JFS_BLKS_SZ((uint64_t)cnt);
+}
 
-    super.map_data[byte_cursor] &= (uint8_t)(~(0x1 << bit_cursor));
+/**
+ * @brief 调整内联文件的大小，新增部分补零，不访问设备
+ * 
+ * @param inode 
+ * @param size 不超过 JFS_INLINE_MAX()
+ * @return int 
+ */
+int jfs_inline_resize(struct juzfs_inode* inode, uint64_t size) {
+    jfs_inode_mark_dirty(inode);
+    if (inode->inline_data == NULL) {
+        if (size == 0) {
+            inode->size = 0;
+            return 0;
+        }
+        inode->inline_data = (uint8_t *)jfs_malloc(JFS_INLINE_MAX());
+        if (inode->inline_data == NULL) {
+            return -ENOMEM;
+        }
+    }
+    if (size > inode->size) {
+        memset(inode->inline_data + inode->size, 0, size - inode->size);
+    }
+    inode->size = size;
+    return 0;
+}
 
+/**
+ * @brief 内联文件转为使用数据块：原内容写入第一个数据块，其余部分为空洞，文件大小不变；失败时保持内联
+ * 
+ * @param inode 
+ * @return int 
+ */
+int jfs_inline_promote(struct juzfs_inode* inode) {
+    uint8_t* data = inode->inline_data;
+    int      ret;
+
+    inode->flags      &= ~JFS_INODE_INLINE;
+    inode->inline_data = NULL;
+    ret = jfs_file_pwrite(inode, data, 0, inode->size);
+    if (ret != (int)inode->size) {                    /* 回滚为内联 */
+        jfs_extent_truncate(inode, 0);
+        inode->flags      |= JFS_INODE_INLINE;
+        inode->inline_data = data;
+        return ret < 0 ? ret : -ENOSPC;
+    }
+    free(data);
+    jfs_inode_mark_dirty(inode);
     return 0;
 }
 
@@ -477,7 +1583,7 @@ int  jfs_dealloc_data_blk(int blk_num) {
  *      2) find qwe's dentry
  * 
  * @param path 
- * @return struct juzfs_dentry* 
+ * @return struct juzfs_dentry* 路径上有inode无法读入（槽损坏）时返回NULL，调用者返回 -EIO
  */
 struct juzfs_dentry* jfs_lookup(const char * path, bool* is_find, bool* is_root) {
     struct juzfs_dentry* dentry_cursor = super.root_dentry;
@@ -487,7 +1593,9 @@ struct juzfs_dentry* jfs_lookup(const char * path, bool* is_find, bool* is_root)
     int   lvl = 0;
     bool is_hit;
     char* fname = NULL;
-    char* path_cpy = (char*)malloc(sizeof(path));
+    char* saveptr;
+    struct juzfs_arena_mark mark = jfs_scratch_mark();
+    char* path_cpy = (char*)jfs_scratch_alloc(strlen(path) + 1);
     *is_root = false;
     strcpy(path_cpy, path);
 
@@ -496,12 +1604,23 @@ struct juzfs_dentry* jfs_lookup(const char * path, bool* is_find, bool* is_root)
         *is_root = true;
         dentry_ret = super.root_dentry;
     }
-    fname = strtok(path_cpy, "/");       
+    else if ((dentry_ret = jfs_dcache_lookup(path, is_find)) != NULL) {
+        jfs_scratch_release(mark);                  /* 命中路径缓存，不必逐级查找 */
+        if (dentry_ret->inode == NULL) {
+            dentry_ret->inode = jfs_read_inode(dentry_ret, dentry_ret->ino);
+        }
+        return dentry_ret->inode != NULL ? dentry_ret : NULL;
+    }
+    fname = strtok_r(path_cpy, "/", &saveptr);       
     while (fname)
     {   
         lvl++;
         if (dentry_cursor->inode == NULL) {           /* Cache机制 */
-            jfs_read_inode(dentry_cursor, dentry_cursor->ino);
+            dentry_cursor->inode = jfs_read_inode(dentry_cursor, dentry_cursor->ino);
+            if (dentry_cursor->inode == NULL) {
+                jfs_scratch_release(mark);
+                return NULL;
+            }
         }
 
         inode = dentry_cursor->inode;
@@ -512,41 +1631,36 @@ struct juzfs_dentry* jfs_lookup(const char * path, bool* is_find, bool* is_root)
             break;
         }
         if (JFS_IS_DIR(inode)) {
-            dentry_cursor = inode->dentrys;
-            is_hit        = false;
-
-            for (int i = 0; i < inode->dir_cnt; i++)
-            {
-                dentry_cursor = &inode->dentrys[i];
-                if (memcmp(dentry_cursor->name, fname, strlen(fname)) == 0) {
-                    is_hit = true;
-                    break;
-                }
-            }
+            dentry_cursor = strlen(fname) < MAX_NAME_LEN ? jfs_find_dentry(inode, fname) : NULL;
+            is_hit        = dentry_cursor != NULL;
             
             if (!is_hit) {
                 *is_find = false;
                 // SFS_DBG("[%s] not found %s\n", __func__, fname);
                 dentry_ret = inode->dentry;
+                if (lvl == total_lvl) {             /* 只缓存父目录存在的负项 */
+                    jfs_dcache_insert(path, dentry_ret, false);
+                }
                 break;
             }
 
             if (is_hit && lvl == total_lvl) {
                 *is_find = true;
                 dentry_ret = dentry_cursor;
+                jfs_dcache_insert(path, dentry_ret, true);
                 break;
             }
         }
-        fname = strtok(NULL, "/"); 
+        fname = strtok_r(NULL, "/", &saveptr); 
     }
 
-    free(path_cpy);
+    jfs_scratch_release(mark);
 
     if (dentry_ret->inode == NULL) {
         dentry_ret->inode = jfs_read_inode(dentry_ret, dentry_ret->ino);
     }
     
-    return dentry_ret;
+    return dentry_ret->inode != NULL ? dentry_ret : NULL;
 }
 
 /**
@@ -590,17 +1704,217 @@ char* jfs_get_name(const char* path) {
 }
 
 /**
- * @brief 
+ * @brief readdir 续读：返回 cookie 之后的下一个子项，内存中没有时继续读入目录块
  * 
  * @param inode 
- * @param dir [0...]
- * @return struct sfs_dentry* 
+ * @param cookie 上次返回的子项的 cookie，0 表示第一项
+ * @return struct sfs_dentry* 目录已读完时返回NULL
  */
-struct juzfs_dentry* jfs_get_dentry(struct juzfs_inode * inode, int dir) {
-    if (dir > inode->dir_cnt-1)
-        return NULL;
+struct juzfs_dentry* jfs_get_dentry(struct juzfs_inode * inode, uint64_t cookie) {
+    int slot = jfs_dir_seek(inode, cookie);
+    int more;
+
+    for (;;) {
+        while (slot < inode->dir_loaded && inode->dentrys[slot] == NULL)
+            slot++;
+        if (slot < inode->dir_loaded)
+            return inode->dentrys[slot];
+        if (JFS_DIR_COMPLETE(inode))
+            return NULL;
+        more = inode->dir_loaded > JFS_DENTRYS_SEG_SIZE() ? inode->dir_loaded : JFS_DENTRYS_SEG_SIZE();
+        if (jfs_read_dentrys(inode, inode->dir_loaded + more) != 0)
+            return NULL;
+    }
+}
+
+/**
+ * @brief 位图只写回改过的段，相邻的脏段合并为一段
+ * 
+ * @param bm 
+ * @param offset 位图在设备上的偏移
+ * @return int 
+ */
+static int jfs_bitmap_sync(struct juzfs_bitmap* bm, uint64_t offset) {
+    struct juzfs_arena_mark mark = jfs_scratch_mark();
+    struct juzfs_iovec*     iov;
+    int                     iovcnt = 0;
+    int                     chunk  = bm->chunk_bits / UINT8_BITS;
+    int                     start, cnt;
+    int                     ret    = 0;
+
+    if (JFS_DEV_MAPPED()) {                         /* 映射时位图已原地更新 */
+        jfs_bitmap_clean(bm);
+        return 0;
+    }
+    iov = (struct juzfs_iovec*)jfs_scratch_alloc(sizeof(struct juzfs_iovec) * (bm->nchunks / 2 + 1));
+    for (start = jfs_bitmap_next_dirty(bm, 0, &cnt); start >= 0; 
+         start = jfs_bitmap_next_dirty(bm, start + cnt, &cnt)) {
+        iov[iovcnt].offset = offset + (uint64_t)start * chunk;
+        iov[iovcnt].buf    = bm->map + (size_t)start * chunk;
+        iov[iovcnt].size   = cnt * chunk;
+        iovcnt++;
+    }
+    if (jfs_driver_writev(iov, iovcnt) != 0) {
+        ret = -EIO;
+    } else {
+        jfs_bitmap_clean(bm);
+    }
+    jfs_scratch_release(mark);
+    return ret;
+}
+
+/**
+ * @brief 写回全部改动：脏链表上的inode（连同平铺目录的脏块）、位图的脏段，再回写块缓存，
+ * 写出的量与改动量成正比，与目录树大小无关；super 只在卸载时写
+ * 
+ * @return int 
+ */
+int jfs_flush(void) {
+    while (super.dirty_inodes != NULL) {            /* 写回成功后从链表摘除 */
+        if (jfs_sync_inode(super.dirty_inodes) != 0) {
+            return -EIO;
+        }
+    }
+    if (jfs_bitmap_sync(&super.ino_bm, super.map_inode_offset) != 0 ||
+        jfs_bitmap_sync(&super.data_bm, super.map_data_offset) != 0) {
+        return -EIO;
+    }
+    return jfs_cache_flush() != 0 ? -EIO : 0;
+}
+
+/**
+ * @brief 后台回写一轮：写回 before 及之前变脏的inode，有inode写出时连同位图脏段；
+ * 块缓存中写回同样已过期的块与本轮写入的块，脏块超过比例时全部写回
+ * 
+ * @param before jfs_now_ms 的时刻
+ * @return int 
+ */
+int jfs_writeback(uint64_t before) {
+    uint64_t start  = jfs_now_ms();
+    int      synced = 0;
+
+    while (super.dirty_inodes != NULL && super.dirty_inodes->dirtied_at <= before) {
+        if (jfs_sync_inode(super.dirty_inodes) != 0) {
+            return -EIO;
+        }
+        synced++;
+    }
+    if (synced > 0 && 
+        (jfs_bitmap_sync(&super.ino_bm, super.map_inode_offset) != 0 ||
+         jfs_bitmap_sync(&super.data_bm, super.map_data_offset) != 0)) {
+        return -EIO;
+    }
+    if (jfs_cache_over_dirty_limit()) {
+        return jfs_cache_flush() != 0 ? -EIO : 0;
+    }
+    return jfs_cache_flush_expired(before, start) != 0 ? -EIO : 0;
+}
+
+struct jfs_range_set {
+    struct juzfs_range*   ranges;
+    int                   cnt;
+    int                   cap;
+    bool                  overflow;                 /* 分配失败，调用者回写整个块缓存 */
+};
+
+static void jfs_range_add(void* arg, uint64_t start, uint64_t len) {
+    struct jfs_range_set* set = (struct jfs_range_set*)arg;
+    struct juzfs_range*   ranges;
+
+    if (set->overflow) {
+        return;
+    }
+    if (set->cnt == set->cap) {
+        set->cap = set->cap == 0 ? 16 : set->cap * 2;
+        ranges   = (struct juzfs_range*)jfs_malloc(sizeof(struct juzfs_range) * set->cap);
+        if (ranges == NULL) {
+            set->overflow = true;
+            return;
+        }
+        if (set->cnt > 0) {
+            memcpy(ranges, set->ranges, sizeof(struct juzfs_range) * set->cnt);
+            free(set->ranges);
+        }
+        set->ranges = ranges;
+    }
+    set->ranges[set->cnt].start = start;
+    set->ranges[set->cnt].len   = len;
+    set->cnt++;
+}
+
+static void jfs_range_add_data(void* arg, uint64_t pblk, uint32_t len) {
+    jfs_range_add(arg, JFS_DATA_OFS(pblk) / JFS_BLK_SZ(), len);
+}
+
+static int jfs_cmp_range(const void* a, const void* b) {
+    uint64_t x = ((struct juzfs_range*)a)->start;
+    uint64_t y = ((struct juzfs_range*)b)->start;
+    return x < y ? -1 : (x > y);
+}
+
+/**
+ * @brief 排序并合并重叠或相邻的区间
+ * 
+ * @return int 合并后的区间数
+ */
+static int jfs_range_merge(struct juzfs_range* ranges, int cnt) {
+    int n = 0;
+
+    qsort(ranges, cnt, sizeof(struct juzfs_range), jfs_cmp_range);
+    for (int i = 0; i < cnt; i++) {
+        if (n > 0 && ranges[i].start <= ranges[n - 1].start + ranges[n - 1].len) {
+            if (ranges[i].start + ranges[i].len > ranges[n - 1].start + ranges[n - 1].len) {
+                ranges[n - 1].len = ranges[i].start + ranges[i].len - ranges[n - 1].start;
+            }
+            continue;
+        }
+        ranges[n++] = ranges[i];
+    }
+    return n;
+}
+
+/**
+ * @brief fsync：只写回一个inode的改动——inode本身（连同平铺目录的脏块）、位图脏段
+ * （新分配的块在崩溃后须仍记为已用），以及块缓存中属于它的脏块：数据块、区段树节点、
+ * inode槽与位图所在的块，不碰其他文件的脏块；最后让设备落盘。
+ * B+树目录的节点不经区段树登记，无法单独挑出，此时回写整个块缓存
+ * 
+ * @param inode 
+ * @return int 
+ */
+int jfs_fsync_inode(struct juzfs_inode* inode) {
+    struct jfs_range_set set = { NULL, 0, 0, false };
+    int ret = 0;
+
+    if (inode->dirty && jfs_sync_inode(inode) != 0) {
+        return -EIO;
+    }
+    if (jfs_bitmap_sync(&super.ino_bm, super.map_inode_offset) != 0 ||
+        jfs_bitmap_sync(&super.data_bm, super.map_data_offset) != 0) {
+        return -EIO;
+    }
 
-    return &inode->dentrys[dir];
+    if (!JFS_IS_DTREE(inode) && !JFS_IS_INLINE(inode) &&
+        jfs_extent_walk(inode, jfs_range_add_data, &set) != 0) {
+        ret = -EIO;
+    }
+    jfs_range_add(&set, JFS_SUPER_OFS / JFS_BLK_SZ(), 1);          /* 挂载时写入的未clean的super */
+    jfs_range_add(&set, JFS_INO_OFS(inode->ino) / JFS_BLK_SZ(), 1);
+    jfs_range_add(&set, super.map_inode_offset / JFS_BLK_SZ(), super.map_inode_blks);
+    jfs_range_add(&set, super.map_data_offset / JFS_BLK_SZ(), super.map_data_blks);
+
+    if (ret == 0) {
+        if (JFS_IS_DTREE(inode) || set.overflow) {
+            ret = jfs_cache_flush();
+        } else {
+            ret = jfs_cache_flush_ranges(set.ranges, jfs_range_merge(set.ranges, set.cnt));
+        }
+    }
+    free(set.ranges);
+    if (ret != 0 || jfs_dev_sync() != 0) {
+        return -EIO;
+    }
+    return 0;
 }
 
 /**
@@ -615,12 +1929,21 @@ int jfs_umount(void) {
         return 0;
     }
 
-    jfs_sync_inode(super.root_dentry->inode);     /* 从根节点向下刷写节点 */
+    jfs_dump_dev_state("run");
+    if (jfs_flush() != 0) {                         /* 只写改过的inode、目录块与位图段 */
+        return -EIO;
+    }
                                                     
+    memset(&juzfs_super_d, 0, sizeof(juzfs_super_d));
     juzfs_super_d.magic               = JFS_MAGIC;
     juzfs_super_d.sz_usage            = super.sz_usage;
+    juzfs_super_d.flags               = JFS_SUPER_CLEAN;
+    juzfs_super_d.free_inodes         = super.ino_bm.nfree;
+    juzfs_super_d.free_data_blks      = super.data_bm.nfree;
 
     juzfs_super_d.max_ino             = super.max_ino;
+    juzfs_super_d.layout_version      = super.layout_version;
+    juzfs_super_d.sz_inode            = super.sz_inode;
     juzfs_super_d.map_inode_blks      = super.map_inode_blks;
     juzfs_super_d.map_inode_offset    = super.map_inode_offset;
     juzfs_super_d.max_data_blks       = super.max_data_blks;
@@ -630,24 +1953,28 @@ int jfs_umount(void) {
     juzfs_super_d.ino_list_offset     = super.ino_list_offset;
     juzfs_super_d.data_offset         = super.data_offset;
 
-    if (jfs_driver_write(JFS_SUPER_OFS, (uint8_t *)&juzfs_super_d, 
-                     sizeof(struct juzfs_super_d)) != 0) {
+    if (jfs_driver_write(JFS_SUPER_OFS, (uint8_t *)&juzfs_super_d, sizeof(struct juzfs_super_d)) != 0 ||
+        jfs_cache_flush() != 0) {                   /* super最后写，其clean标记之前的改动都已写出 */
         return -EIO;
     }
-
-    if (jfs_driver_write(juzfs_super_d.map_inode_offset, (uint8_t *)(super.map_inode), 
-                         JFS_BLKS_SZ(juzfs_super_d.map_inode_blks)) != 0) {
+    if (jfs_dev_sync() != 0) {
         return -EIO;
     }
-
-    if (jfs_driver_write(juzfs_super_d.map_data_offset, (uint8_t *)(super.map_data), 
-                         JFS_BLKS_SZ(juzfs_super_d.map_data_blks)) != 0) {
-        return -EIO;
+    jfs_dump_cache();
+    jfs_dump_dcache();
+    jfs_dump_dev_state("umount");
+    jfs_dump_frag();                                /* 放在设备计数之后，补读的inode不计入 */
+    jfs_cache_destroy();
+    jfs_dcache_destroy();
+
+    jfs_bitmap_destroy(&super.ino_bm);
+    jfs_bitmap_destroy(&super.data_bm);
+    if (!JFS_DEV_MAPPED()) {
+        free(super.map_inode);
+        free(super.map_data);
     }
-
-    free(super.map_inode);
-    free(super.map_data);
-    ddriver_close(JFS_DRIVER());
+    JFS_BACKEND()->close(JFS_DRIVER());
+    super.base = NULL;
 
     printf("inode count=%d\n",inode_cnt);
 
@@ -662,46 +1989,38 @@ int jfs_umount(void) {
  * @return int 
  */
 int juzfs_drop_dentry(struct juzfs_inode * inode, struct juzfs_dentry * dentry) {
-    struct juzfs_dentry* old_dentrys;
-    int new_list_size;
-    bool is_find = false;
-    int dentry_cursor;
-    
-    for (dentry_cursor=0; dentry_cursor < inode->dir_cnt;dentry_cursor++) {
-        if (strcmp(inode->dentrys[dentry_cursor].name,dentry->name) == 0) {
-            is_find = true;
-            break;
-        }
-    }
-    if (!is_find) {
+    int nblks;
+
+    if (dentry->parent == NULL || dentry->parent->inode != inode ||
+        dentry->idx >= inode->dir_loaded || inode->dentrys[dentry->idx] != dentry) {
         return -ENOENT;
     }
-
-    //将要删除的dentry之后的dentry往前移
-    if (dentry_cursor != inode->dir_cnt-1) 
-        memcpy(&(inode->dentrys[dentry_cursor]),&(inode->dentrys[dentry_cursor+1]),sizeof(struct juzfs_dentry) * (inode->dir_cnt - dentry_cursor - 1));
-
-    old_dentrys = inode->dentrys;
-    new_list_size = JFS_ROUND_UP((inode->dir_cnt-1),JFS_DENTRYS_SEG_SIZE());
-    inode->dir_cnt--;
-
-    int a = new_list_size/JFS_DENTRYS_SEG_SIZE();
-    for(int i = inode->dentrys_list_size/JFS_DENTRYS_SEG_SIZE()-1; i >= a; i--){
-        jfs_dealloc_data_blk(inode->data_offsets[i]);
+    if (JFS_IS_DTREE(inode)) {                      /* 直接从B+树删除 */
+        if (jfs_dtree_delete(inode, dentry->name) != 0) {
+            return -EIO;
+        }
+        jfs_dcache_forget_dentry(dentry);
+        jfs_dir_remove(inode, dentry);
+        jfs_inode_mark_dirty(inode);
+        inode->dir_cnt--;
+        free(dentry);
+        return inode->dir_cnt;
     }
-
-    if (inode->dentrys_list_size/JFS_DENTRYS_SEG_SIZE() != new_list_size/JFS_DENTRYS_SEG_SIZE() && inode->dir_cnt != 0) {
-        inode->dentrys = (struct juzfs_dentry*)malloc(sizeof(struct juzfs_dentry) * new_list_size);
-        memcpy(inode->dentrys, old_dentrys, sizeof(struct juzfs_dentry)*inode->dir_cnt);
-        free(old_dentrys);
+    if (jfs_read_dentrys(inode, inode->dir_cnt) != 0) {     /* 写回时保序压缩，目录须完整在内存中 */
+        return -EIO;
     }
+    jfs_dirent_convert(inode);
 
-    if(inode->dir_cnt == 0) {
-        inode->dentrys = NULL;
-    }
+    jfs_dcache_forget_dentry(dentry);
+    jfs_dir_mark_dirty(inode, dentry->idx);
+    jfs_dir_remove(inode, dentry);
+    inode->dir_cnt--;
+    nblks = JFS_ROUND_UP(inode->size, JFS_BLK_SZ()) / JFS_BLK_SZ();
+    inode->size -= JFS_DIRENT_LEN(strlen(dentry->name));
+    if (JFS_ROUND_UP(inode->size, JFS_BLK_SZ()) / JFS_BLK_SZ() < nblks)     /* 释放多余的目录块 */
+        jfs_extent_truncate(inode, JFS_ROUND_UP(inode->size, JFS_BLK_SZ()) / JFS_BLK_SZ());
 
-    inode->dentrys_list_size = new_list_size;
-    
+    free(dentry);
     return inode->dir_cnt;
 }
 
@@ -738,39 +2057,46 @@ int juzfs_drop_inode(struct juzfs_inode * inode) {
     struct juzfs_dentry*  dentry_to_free;
     struct juzfs_inode*   inode_cursor;
 
-    int byte_cursor; 
-    int bit_cursor; 
     bool is_find = false;
-    int data_blks;
 
     if (inode == super.root_dentry->inode) {
         return -EINVAL;
     }
 
     /* 调整inodemap */
-    byte_cursor = (int)(inode->ino)/UINT8_BITS;
-    bit_cursor  = (int)(inode->ino)%UINT8_BITS;
-    super.map_inode[byte_cursor] &= (uint8_t)(~(0x1 << bit_cursor));
+    jfs_bitmap_free(&super.ino_bm, inode->ino);
 
     if (JFS_IS_DIR(inode)) {
-        for(int i = 0; i<inode->dir_cnt;i++)
+        jfs_read_dentrys(inode, inode->dir_cnt);
+        if (JFS_IS_DTREE(inode)) {                  /* 整棵树一并释放，子项只需从内存中摘除 */
+            jfs_dtree_destroy(inode);
+        }
+        while (inode->dir_loaded > 0)               /* 从末尾删起，不引起数组内的搬移 */
         {   
-            dentry_cursor = &(inode->dentrys[i]);
+            dentry_cursor = inode->dentrys[inode->dir_loaded - 1];
+            if (dentry_cursor->inode == NULL) {     /* 未读入的子项也要释放其块 */
+                dentry_cursor->inode = jfs_read_inode(dentry_cursor, dentry_cursor->ino);
+            }
             inode_cursor = dentry_cursor->inode;
-            juzfs_drop_inode(inode_cursor);
-            juzfs_drop_dentry(inode, dentry_cursor);
-        }
-    }
-    else if (JFS_IS_FILE(inode)) {
-        data_blks = JFS_ROUND_UP(inode->size,JFS_BLK_SZ() / JFS_BLK_SZ());
-
-        if (inode->data_offsets){
-            for (int i = 0; i < data_blks; i++) {
-                jfs_dealloc_data_blk(inode->data_offsets[i]);
+            if (inode_cursor != NULL) {
+                juzfs_drop_inode(inode_cursor);
+            }
+            if (JFS_IS_DTREE(inode)) {
+                jfs_dcache_forget_dentry(dentry_cursor);
+                jfs_dir_remove(inode, dentry_cursor);
+                free(dentry_cursor);
+            }
+            else if (juzfs_drop_dentry(inode, dentry_cursor) < 0) {
+                break;
             }
         }
+        jfs_dir_free(inode);
     }
-    
+
+    jfs_extent_truncate(inode, 0);                  /* 释放数据块与区段树节点 */
+    free(inode->inline_data);
+    jfs_inode_clean(inode);                         /* inode号已释放，不再写回 */
+
     free(inode);
     return 0;
 }
@@ -0,0 +1,133 @@
+#include "juzfs.h"
+#include "types.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+extern struct juzfs_super super;
+
+/******************************************************************************
+* SECTION: 后台回写
+* 改动先留在内存（脏inode链表、位图脏段、块缓存脏块），由后台线程每 writeback_ms 检查一次，
+* 变脏超过 dirty_expire_ms 的写回；块缓存中的脏块达到 dirty_ratio 时立即唤醒，全部写回。
+* FUSE 以多线程分发请求，各操作与后台线程经同一把全局锁串行执行，线程等待时释放该锁。
+*******************************************************************************/
+static pthread_mutex_t jfs_big_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  wb_cond;
+static pthread_t       wb_thread;
+static bool            wb_running;
+static bool            wb_stop;
+static bool            wb_kicked;
+static int             wb_interval_ms;
+static int             wb_expire_ms;
+
+/**
+ * @brief 单调时钟，毫秒
+ *
+ * @return uint64_t
+ */
+uint64_t jfs_now_ms(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void jfs_lock(void) {
+    pthread_mutex_lock(&jfs_big_lock);
+}
+
+void jfs_unlock(void) {
+    pthread_mutex_unlock(&jfs_big_lock);
+}
+
+/**
+ * @brief 唤醒后台线程立即回写一轮，须持有全局锁；未启动后台回写时为空操作
+ */
+void jfs_wb_kick(void) {
+    if (!wb_running) {
+        return;
+    }
+    wb_kicked = true;
+    pthread_cond_signal(&wb_cond);
+}
+
+static void* jfs_wb_main(void* arg) {
+    struct timespec deadline;
+    uint64_t        now;
+
+    jfs_lock();
+    while (!wb_stop) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec  += wb_interval_ms / 1000;
+        deadline.tv_nsec += (long)(wb_interval_ms % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        while (!wb_stop && !wb_kicked &&
+               pthread_cond_timedwait(&wb_cond, &jfs_big_lock, &deadline) != ETIMEDOUT);
+        if (wb_stop) {
+            break;
+        }
+        wb_kicked = false;
+        now       = jfs_now_ms();
+        if (jfs_writeback(now > (uint64_t)wb_expire_ms ? now - wb_expire_ms : 0) != 0) {
+            SFS_DBG("[%s] writeback error\n", __func__);
+        }
+    }
+    jfs_unlock();
+    return NULL;
+}
+
+/**
+ * @brief 挂载后启动后台回写
+ *
+ * @param options writeback_ms 为0时不启动，改动只在 fsync 与卸载时写出
+ * @return int
+ */
+int jfs_wb_start(struct custom_options options) {
+    pthread_condattr_t attr;
+
+    if (options.writeback_ms <= 0) {
+        return 0;
+    }
+    wb_interval_ms = options.writeback_ms;
+    wb_expire_ms   = options.dirty_expire_ms > 0 ? options.dirty_expire_ms : 0;
+    wb_stop        = false;
+    wb_kicked      = false;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&wb_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    jfs_cache_set_dirty_ratio(options.dirty_ratio);
+    if (pthread_create(&wb_thread, NULL, jfs_wb_main, NULL) != 0) {
+        jfs_cache_set_dirty_ratio(0);
+        pthread_cond_destroy(&wb_cond);
+        return -EAGAIN;
+    }
+    wb_running = true;
+    return 0;
+}
+
+/**
+ * @brief 卸载前停止后台回写，等待正在进行的一轮结束；剩余改动由 jfs_umount 写出
+ */
+void jfs_wb_stop(void) {
+    if (!wb_running) {
+        return;
+    }
+    jfs_lock();
+    wb_stop = true;
+    pthread_cond_signal(&wb_cond);
+    jfs_unlock();
+    pthread_join(wb_thread, NULL);
+    pthread_cond_destroy(&wb_cond);
+    jfs_cache_set_dirty_ratio(0);
+    wb_running = false;
+}
@@ -0,0 +1,35 @@
+#!/bin/bash
+# 稳态热路径堆分配回归测试
+# 文件与目录项建立后，重复的 read/write/getattr 只使用线程临时区，
+# run 阶段的堆分配次数不应随操作次数增长
+
+# shellcheck source=/dev/null
+source "$(cd "$(dirname "$0")" && pwd)"/common.sh
+
+# 参数: 稳态操作轮数；单线程挂载并关闭后台回写，避免工作线程数与回写时机影响临时区的首次分配
+function steady_allocs() {
+    bench_mount -s --writeback_ms=0 "$@"
+    dd if=/dev/urandom of="$MNTPOINT"/file0 bs=1500 count=1 2>/dev/null
+    for _ in $(seq 1 "$ROUNDS"); do
+        dd if=/dev/urandom of="$MNTPOINT"/file0 bs=700 count=1 seek=1 conv=notrunc 2>/dev/null
+        cat "$MNTPOINT"/file0 >/dev/null
+        stat "$MNTPOINT"/file0 >/dev/null
+    done
+    bench_umount
+    heap_stat run
+}
+
+for OPTS in "" "--cache_size=0"; do
+    TEST_CASE="allocs - 稳态读写不分配堆内存 ${OPTS:-(默认缓存)}"
+    ROUNDS=5
+    FEW=$(steady_allocs $OPTS)
+    ROUNDS=50
+    MANY=$(steady_allocs $OPTS)
+    if [[ -n "$FEW" && "$FEW" == "$MANY" ]]; then
+        pass "$TEST_CASE (alloc=$FEW)"
+    else
+        fail "$TEST_CASE: 5轮 alloc=$FEW, 50轮 alloc=$MANY"
+    fi
+done
+
+exit $FAILED
@@ -0,0 +1,64 @@
+#!/bin/bash
+# 大目录回归：目录超过 JFS_DIR_FLAT_MAX_BLKS 块后转为按名字哈希索引的B+树。
+# 冷挂载后 stat 一个子项只应读 O(log n) 个块，不把整个目录读入内存；
+# 删除一半子项后列表正确，删除目录后空闲块数回到建目录之前
+# 用法: ./bigdir.sh [子项数，默认100000] [额外挂载选项...]
+
+# shellcheck source=/dev/null
+source "$(cd "$(dirname "$0")" && pwd)"/common.sh
+
+NENTS=${1:-100000}
+[[ $# -gt 0 ]] && shift
+export JFS_IMAGE=${JFS_IMAGE:-"$BENCH_PATH"/bigdir.img}     # ddriver 的 inode 数不够
+export JFS_IMAGE_SZ=$((NENTS / 32 + 16))M
+
+bench_mount "$@"
+FREE0=$(stat -f -c %f "$MNTPOINT")
+mkdir "$MNTPOINT"/big
+START=$(date +%s%N)
+(cd "$MNTPOINT"/big && seq -f "file-%g" 1 "$NENTS" | xargs touch)
+ELAPSED=$((($(date +%s%N) - START) / 1000000))
+DIR_SZ=$(stat -c %s "$MNTPOINT"/big)
+bench_umount
+echo "创建 $NENTS 项: ${ELAPSED}ms, 目录 $DIR_SZ 字节"
+
+TEST_CASE="bigdir - 冷挂载查找单个子项"
+JFS_IMAGE_KEEP=1 bench_mount "$@"
+stat "$MNTPOINT"/big/file-$((NENTS / 3)) >/dev/null &&
+    ! stat "$MNTPOINT"/big/missing >/dev/null 2>&1
+FOUND=$?
+bench_umount
+READS=$(device_stat run read)
+if (( FOUND == 0 && READS <= 32 )); then
+    pass "$TEST_CASE (read=$READS)"
+else
+    fail "$TEST_CASE: 结果错误或读块过多 (read=$READS)"
+fi
+
+TEST_CASE="bigdir - 删除一半子项, 重挂后列表正确"
+JFS_IMAGE_KEEP=1 bench_mount "$@"
+(cd "$MNTPOINT"/big && seq -f "file-%g" 1 2 "$NENTS" | xargs rm)
+bench_umount
+JFS_IMAGE_KEEP=1 bench_mount "$@"
+ls -f "$MNTPOINT"/big | grep -v '^\.' | sort > "$BENCH_PATH"/bigdir.out
+seq -f "file-%g" 2 2 "$NENTS" | sort | cmp -s - "$BENCH_PATH"/bigdir.out
+LISTED=$?
+rm -r "$MNTPOINT"/big
+FREE1=$(stat -f -c %f "$MNTPOINT")
+bench_umount
+if (( LISTED == 0 )); then
+    pass "$TEST_CASE"
+else
+    fail "$TEST_CASE: 列表不一致"
+fi
+
+TEST_CASE="bigdir - 删除目录后释放全部块"
+if (( FREE0 == FREE1 )); then
+    pass "$TEST_CASE"
+else
+    fail "$TEST_CASE: 空闲块 $FREE0 -> $FREE1"
+fi
+
+rm -f "$BENCH_PATH"/bigdir.out
+[[ "$JFS_IMAGE" == "$BENCH_PATH"/bigdir.img ]] && rm -f "$JFS_IMAGE"
+exit $FAILED
@@ -0,0 +1,36 @@
+#!/bin/bash
+# 大文件回归：在文件镜像上写入远超旧版六块上限的文件，卸载重挂后校验内容，
+# 并输出区段数与元数据IO
+# 用法: JFS_IMAGE=/tmp/juzfs.img ./bigfile.sh [文件大小MiB，默认512] [额外挂载选项...]
+
+# shellcheck source=/dev/null
+source "$(cd "$(dirname "$0")" && pwd)"/common.sh
+
+if [[ -z "$JFS_IMAGE" ]]; then
+    echo "需要文件镜像: JFS_IMAGE=<路径> $0"
+    exit 1
+fi
+
+SIZE_MB=${1:-512}
+[[ $# -gt 0 ]] && shift
+export JFS_IMAGE_SZ=$((SIZE_MB * 2 + 64))M
+DATA="$BENCH_PATH"/bigfile.data
+
+dd if=/dev/urandom of="$DATA" bs=1M count="$SIZE_MB" status=none
+
+bench_mount "$@"
+cp "$DATA" "$MNTPOINT"/big
+bench_umount
+grep -a "^frag:" "$LOG"
+
+JFS_IMAGE_KEEP=1 bench_mount "$@"
+if cmp -s "$DATA" "$MNTPOINT"/big; then
+    pass "${SIZE_MB}MiB 文件重挂后内容一致"
+else
+    fail "${SIZE_MB}MiB 文件重挂后内容不一致"
+fi
+bench_umount
+echo "device[run]: read=$(device_stat run read) write=$(device_stat run write)"
+
+rm -f "$DATA"
+exit $FAILED
@@ -0,0 +1,74 @@
+#!/bin/bash
+# 基准/回归测试公共函数：前台挂载juzfs并把输出记录到日志，
+# 卸载后从日志中解析 device[phase] 与 cache 统计行
+# 设置 JFS_IMAGE=<镜像路径> 时使用文件镜像后端 (默认4MiB，可用 JFS_IMAGE_SZ 指定，
+# JFS_IMAGE_KEEP=1 时沿用已有镜像)，否则使用 ddriver (JFS_IMAGE_KEEP=1 时不重置)
+
+BENCH_PATH=$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)
+MNTPOINT="$BENCH_PATH"/mnt
+PROJECT_NAME="juzfs"
+FS_BIN="$BENCH_PATH"/../../build/"${PROJECT_NAME}"
+LOG="$BENCH_PATH"/bench.log
+FAILED=0
+
+function pass() {
+    echo -e "\033[32mpass: $1\033[0m"
+}
+
+function fail() {
+    FAILED=1
+    echo -e "\033[31mfail: $1\033[0m"
+}
+
+function check_mount() {
+    mount | grep "$(realpath "$MNTPOINT")" >/dev/null
+}
+
+# 参数: 额外的挂载选项，如 --cache_size=0
+function bench_mount() {
+    mkdir -p "$MNTPOINT"
+    while check_mount; do
+        umount "$MNTPOINT"
+        sleep 1
+    done
+    if [[ -n "$JFS_IMAGE" ]]; then
+        if [[ -z "$JFS_IMAGE_KEEP" ]]; then
+            rm -f "$JFS_IMAGE"
+            truncate -s "${JFS_IMAGE_SZ:-4M}" "$JFS_IMAGE"
+        fi
+        DEVICE_OPTS=(--backend=file --device="$JFS_IMAGE")
+    else
+        [[ -z "$JFS_IMAGE_KEEP" ]] && ddriver -r >/dev/null
+        DEVICE_OPTS=(--device="$HOME"/ddriver)
+    fi
+    "$FS_BIN" "${DEVICE_OPTS[@]}" "$@" -f "$MNTPOINT" >"$LOG" 2>&1 &
+    FS_PID=$!
+    for _ in $(seq 1 50); do
+        check_mount && return 0
+        sleep 0.1
+    done
+    fail "挂载失败, 见 $LOG"
+    exit 1
+}
+
+function bench_umount() {
+    umount "$MNTPOINT"
+    wait "$FS_PID"
+}
+
+# 模拟崩溃：SIGKILL 文件系统进程，不经过卸载，内存中未写回的改动丢失
+function bench_crash() {
+    kill -9 "$FS_PID"
+    wait "$FS_PID" 2>/dev/null
+    umount "$MNTPOINT"
+}
+
+# 参数: 阶段名(mount/run/umount) 字段名(read/write/seek)
+function device_stat() {
+    grep -a "^device\[$1\]" "$LOG" | tail -1 | sed -E "s/.* $2=([0-9]+).*/\1/"
+}
+
+# 参数: 阶段名(mount/run/umount)，输出该阶段的堆分配次数
+function heap_stat() {
+    grep -a "^heap\[$1\]" "$LOG" | tail -1 | sed -E "s/.* alloc=([0-9]+).*/\1/"
+}
@@ -0,0 +1,40 @@
+#!/bin/bash
+# 路径缓存基准：建一棵多层目录树后反复 ls -lR / stat 不存在的文件，
+# 输出卸载时的 dcache 命中率，并与关闭路径缓存时的列表结果对比
+# 用法: ./dcache.sh [额外挂载选项...]
+
+# shellcheck source=/dev/null
+source "$(cd "$(dirname "$0")" && pwd)"/common.sh
+
+# 参数: 额外挂载选项；输出 ls -lR 的文件名列表
+function workload_lsr() {
+    bench_mount "$@"
+    for d in a b c; do
+        mkdir -p "$MNTPOINT"/$d/sub/deep
+        for i in $(seq 1 8); do
+            touch "$MNTPOINT"/$d/sub/deep/f$i
+        done
+    done
+    for _ in 1 2 3; do
+        ls -lR "$MNTPOINT" | awk 'NF > 2 { print $NF }' > "$BENCH_PATH"/dcache.out
+        stat "$MNTPOINT"/a/sub/deep/missing >/dev/null 2>&1
+    done
+    rm -r "$MNTPOINT"/b
+    ls -R "$MNTPOINT" >> "$BENCH_PATH"/dcache.out
+    bench_umount
+}
+
+TEST_CASE="dcache - ls -lR 命中路径缓存, 结果与关闭缓存时一致"
+workload_lsr --dcache_size=0 "$@"
+cp "$BENCH_PATH"/dcache.out "$BENCH_PATH"/dcache.ref
+workload_lsr "$@"
+DCACHE=$(grep -a "^dcache:" "$LOG" | tail -1)
+HITS=$(echo "$DCACHE" | sed -E "s/.* hit=([0-9]+).*/\1/")
+if cmp -s "$BENCH_PATH"/dcache.ref "$BENCH_PATH"/dcache.out && (( HITS > 0 )); then
+    pass "$TEST_CASE ($DCACHE)"
+else
+    fail "$TEST_CASE: 列表不一致或没有命中 ($DCACHE)"
+fi
+
+rm -f "$BENCH_PATH"/dcache.out "$BENCH_PATH"/dcache.ref
+exit $FAILED
@@ -0,0 +1,36 @@
+#!/bin/bash
+# 设备操作次数回归测试 (IOC_REQ_DEVICE_STATE)
+# 与IO单位对齐的整块写不应先读设备 (read-modify-write)
+
+# shellcheck source=/dev/null
+source "$(cd "$(dirname "$0")" && pwd)"/common.sh
+
+# 4KiB = 4个逻辑块 = 8个IO单位
+function aligned_write() {
+    dd if=/dev/urandom of="$MNTPOINT"/file0 bs=4096 count=1 2>/dev/null
+}
+
+TEST_CASE="devops 1 - 关闭缓存, 对齐写直接下发"
+bench_mount --cache_size=0
+aligned_write
+bench_umount
+READS=$(device_stat run read)
+WRITES=$(device_stat run write)
+if [[ "$READS" == "0" && "$WRITES" == "8" ]]; then
+    pass "$TEST_CASE (read=$READS write=$WRITES)"
+else
+    fail "$TEST_CASE: 期望 read=0 write=8, 实际 read=$READS write=$WRITES"
+fi
+
+TEST_CASE="devops 2 - 开启缓存, 整块覆盖写不读设备"
+bench_mount
+aligned_write
+bench_umount
+READS=$(device_stat run read)
+if [[ "$READS" == "0" ]]; then
+    pass "$TEST_CASE (read=$READS)"
+else
+    fail "$TEST_CASE: 期望 read=0, 实际 read=$READS"
+fi
+
+exit $FAILED
@@ -0,0 +1,107 @@
+/**
+ * 目录查找微基准：在一个大目录中按名字随机查找子项，
+ * 对比逐项 strcmp 的线性扫描（原实现）与按名字哈希的开放寻址表；
+ * 再随机删除一半子项，检查剩余子项仍能查到、已删除的查不到。
+ *
+ * 构建: cmake -DJFS_BUILD_BENCH=ON ... && ./dir_bench [子项数] [查找次数]
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#include "../../src/juzfs_dir.c"
+
+void* jfs_malloc(size_t size) {
+    return malloc(size);
+}
+
+void* jfs_calloc(size_t nmemb, size_t size) {
+    return calloc(nmemb, size);
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static struct juzfs_dentry* linear_find(struct juzfs_inode* dir, const char* name) {
+    for (int i = 0; i < dir->dir_loaded; i++) {
+        if (strcmp(dir->dentrys[i]->name, name) == 0) {
+            return dir->dentrys[i];
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char** argv) {
+    int                  nents   = argc > 1 ? atoi(argv[1]) : 100000;
+    int                  lookups = argc > 2 ? atoi(argv[2]) : 20000;
+    struct juzfs_inode   dir;
+    struct juzfs_dentry* dentry;
+    char                 name[MAX_NAME_LEN];
+    int*                 order   = (int*)malloc(sizeof(int) * nents);
+    int                  i, j, tmp, errors = 0;
+    double               start, linear, hashed;
+
+    memset(&dir, 0, sizeof(dir));
+    for (i = 0; i < nents; i++) {
+        snprintf(name, sizeof(name), "file-%d", i);
+        jfs_dir_add(&dir, new_dentry(name, NULL, FILE_TYPE));
+    }
+
+    srand(1);
+    start = now_ns();
+    for (i = 0; i < lookups; i++) {
+        snprintf(name, sizeof(name), "file-%d", rand() % nents);
+        errors += linear_find(&dir, name) == NULL;
+    }
+    linear = (now_ns() - start) / lookups;
+
+    srand(1);
+    start = now_ns();
+    for (i = 0; i < lookups; i++) {
+        snprintf(name, sizeof(name), "file-%d", rand() % nents);
+        errors += jfs_dir_find(&dir, name) == NULL;
+    }
+    hashed = (now_ns() - start) / lookups;
+
+    for (i = 0; i < nents; i++) {                  /* 随机删除一半 */
+        order[i] = i;
+    }
+    for (i = nents - 1; i > 0; i--) {
+        j        = rand() % (i + 1);
+        tmp      = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+    for (i = 0; i < nents / 2; i++) {
+        snprintf(name, sizeof(name), "file-%d", order[i]);
+        dentry = jfs_dir_find(&dir, name);
+        jfs_dir_remove(&dir, dentry);
+        free(dentry);
+    }
+    for (i = 0; i < nents; i++) {
+        snprintf(name, sizeof(name), "file-%d", order[i]);
+        errors += (jfs_dir_find(&dir, name) == NULL) != (i < nents / 2);
+    }
+    for (i = 0; i < dir.dir_loaded; i++) {
+        errors += dir.dentrys[i] != NULL && dir.dentrys[i]->idx != i;
+    }
+
+    printf("dir entries=%d lookups=%d\n", nents, lookups);
+    printf("  linear strcmp scan : %10.1f ns/op\n", linear);
+    printf("  hashed lookup      : %10.1f ns/op (x%.1f)\n", hashed, linear / hashed);
+    printf("  remove half, recheck: %s\n", errors == 0 ? "ok" : "MISMATCH");
+    while (dir.dir_loaded > 0) {
+        dentry = dir.dentrys[dir.dir_loaded - 1];
+        jfs_dir_remove(&dir, dentry);
+        free(dentry);
+    }
+    free(order);
+    return errors != 0;
+}
@@ -0,0 +1,41 @@
+#!/bin/bash
+# 卸载写回回归：建一棵目录树，重挂后 ls -lR 读入全部inode，再新建、删除各一个文件；
+# 卸载时只写改过的inode、目录块与位图段，写次数不应随目录树大小增长
+# 用法: ./flush.sh [大树的目录数，默认100] [额外挂载选项...]
+
+# shellcheck source=/dev/null
+source "$(cd "$(dirname "$0")" && pwd)"/common.sh
+
+NDIRS=${1:-100}
+[[ $# -gt 0 ]] && shift
+EXTRA_OPTS=("$@")
+export JFS_IMAGE=${JFS_IMAGE:-"$BENCH_PATH"/flush.img}      # ddriver 的 inode 数不够
+export JFS_IMAGE_SZ=$((NDIRS / 4 + 8))M
+
+# 参数: 目录数 (每个目录20个文件)；输出卸载阶段的设备写次数
+function umount_writes() {
+    bench_mount "${EXTRA_OPTS[@]}"
+    for d in $(seq 1 "$1"); do
+        mkdir "$MNTPOINT"/d"$d"
+        (cd "$MNTPOINT"/d"$d" && seq -f "f%g" 1 20 | xargs touch)
+    done
+    bench_umount
+    JFS_IMAGE_KEEP=1 bench_mount "${EXTRA_OPTS[@]}"
+    ls -lR "$MNTPOINT" >/dev/null
+    touch "$MNTPOINT"/d1/new
+    rm "$MNTPOINT"/d2/f1
+    bench_umount
+    device_stat umount write
+}
+
+TEST_CASE="flush - 少量改动, 卸载写次数与目录树大小无关"
+SMALL=$(umount_writes 5)
+LARGE=$(umount_writes "$NDIRS")
+if [[ -n "$SMALL" && -n "$LARGE" ]] && (( LARGE <= SMALL + 2 )); then
+    pass "$TEST_CASE (5 目录 write=$SMALL, $NDIRS 目录 write=$LARGE)"
+else
+    fail "$TEST_CASE: 5 目录 write=$SMALL, $NDIRS 目录 write=$LARGE"
+fi
+
+[[ "$JFS_IMAGE" == "$BENCH_PATH"/flush.img ]] && rm -f "$JFS_IMAGE"
+exit $FAILED
@@ -0,0 +1,46 @@
+#!/bin/bash
+# 写回回归：文件系统进程被 SIGKILL 后重挂，fsync 过的文件完整；
+# 后台回写开启时，超过 dirty_expire_ms 的改动无需 fsync 也已在镜像中。
+# SIGKILL 后宿主页缓存仍在，这里只验证写回的范围与顺序，不验证掉电后的持久性
+# 用法: ./fsync.sh [额外挂载选项...]
+
+# shellcheck source=/dev/null
+source "$(cd "$(dirname "$0")" && pwd)"/common.sh
+
+export JFS_IMAGE=${JFS_IMAGE:-"$BENCH_PATH"/fsync.img}      # 崩溃后沿用同一镜像
+export JFS_IMAGE_SZ=16M
+REF="$BENCH_PATH"/fsync.ref
+dd if=/dev/urandom of="$REF" bs=64K count=4 status=none
+
+TEST_CASE="fsync - 崩溃后 fsync 过的文件完整"
+bench_mount "$@"                                           # 默认30s才过期，测试期间不会后台写回
+mkdir "$MNTPOINT"/d
+dd if="$REF" of="$MNTPOINT"/d/synced bs=64K conv=fsync status=none
+sync "$MNTPOINT"/d "$MNTPOINT"                              # fsyncdir，目录项落盘
+dd if="$REF" of="$MNTPOINT"/unsynced bs=64K status=none
+bench_crash
+JFS_IMAGE_KEEP=1 bench_mount "$@"
+if cmp -s "$REF" "$MNTPOINT"/d/synced; then
+    pass "$TEST_CASE"
+else
+    fail "$TEST_CASE: 内容不一致"
+fi
+bench_umount
+
+TEST_CASE="fsync - 后台回写, 崩溃只丢失最近的改动"
+bench_mount --writeback_ms=100 --dirty_expire_ms=200 "$@"
+mkdir "$MNTPOINT"/bg
+cp "$REF" "$MNTPOINT"/bg/old
+sleep 1
+bench_crash
+JFS_IMAGE_KEEP=1 bench_mount "$@"
+if cmp -s "$REF" "$MNTPOINT"/bg/old; then
+    pass "$TEST_CASE"
+else
+    fail "$TEST_CASE: 过期的改动未写回"
+fi
+bench_umount
+
+rm -f "$REF"
+[[ "$JFS_IMAGE" == "$BENCH_PATH"/fsync.img ]] && rm -f "$JFS_IMAGE"
+exit $FAILED
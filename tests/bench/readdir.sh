@@ -0,0 +1,47 @@
+#!/bin/bash
+# readdir 回归：在文件镜像上建一个大目录，冷挂载后 ls 计时，
+# 并检查重挂前后列出的名字一致；列目录只读目录块，不读入子项的 inode。
+# 平铺目录的目录项为变长格式，短名字的小目录所占字节数应远小于定长项 (136B/项)；
+# 大目录转为B+树，其大小见 bigdir.sh
+# 用法: ./readdir.sh [子项数，默认10000] [额外挂载选项...]
+
+# shellcheck source=/dev/null
+source "$(cd "$(dirname "$0")" && pwd)"/common.sh
+
+NENTS=${1:-10000}
+[[ $# -gt 0 ]] && shift
+export JFS_IMAGE=${JFS_IMAGE:-"$BENCH_PATH"/readdir.img}   # ddriver 的 inode 数不够
+export JFS_IMAGE_SZ=$((NENTS / 64 + 16))M
+
+bench_mount "$@"
+mkdir "$MNTPOINT"/big "$MNTPOINT"/small
+(cd "$MNTPOINT"/small && seq -f "file-%g" 1 200 | xargs touch)
+DIR_SZ=$(stat -c %s "$MNTPOINT"/small)
+(cd "$MNTPOINT"/big && seq -f "file-%g" 1 "$NENTS" | xargs touch)
+ls -f "$MNTPOINT"/big | sort > "$BENCH_PATH"/readdir.ref
+bench_umount
+
+TEST_CASE="readdir - 变长目录项, 200 项占用 $DIR_SZ 字节"
+if (( DIR_SZ * 5 <= 200 * 136 )); then
+    pass "$TEST_CASE ($((DIR_SZ / 200))B/项)"
+else
+    fail "$TEST_CASE: 超过定长格式的 1/5"
+fi
+
+TEST_CASE="readdir - 冷挂载列出 $NENTS 项, 重挂后结果一致"
+JFS_IMAGE_KEEP=1 bench_mount "$@"
+START=$(date +%s%N)
+ls -f "$MNTPOINT"/big | sort > "$BENCH_PATH"/readdir.out
+ELAPSED=$((($(date +%s%N) - START) / 1000000))
+bench_umount
+READS=$(device_stat run read)
+if cmp -s "$BENCH_PATH"/readdir.ref "$BENCH_PATH"/readdir.out &&
+   (( $(wc -l < "$BENCH_PATH"/readdir.out) == NENTS + 2 )); then
+    pass "$TEST_CASE (${ELAPSED}ms, read=$READS)"
+else
+    fail "$TEST_CASE: 列表不一致"
+fi
+
+rm -f "$BENCH_PATH"/readdir.ref "$BENCH_PATH"/readdir.out
+[[ "$JFS_IMAGE" == "$BENCH_PATH"/readdir.img ]] && rm -f "$JFS_IMAGE"
+exit $FAILED
@@ -0,0 +1,48 @@
+#!/bin/bash
+# 寻道次数基准：运行 rw.sh / cp.sh 的工作负载，按阶段输出每次设备IO的寻道数
+# 用法: ./seeks.sh [额外挂载选项...]，如 ./seeks.sh --cache_size=0
+
+# shellcheck source=/dev/null
+source "$(cd "$(dirname "$0")" && pwd)"/common.sh
+
+GOLDEN="Lorem ipsum dolor sit amet, consectetur adipisicing elit, sed do eiusmod tempor incididunt ut labore et dolore magna aliqua. Ut enim ad minim veniam, quis nostrud exercitation ullamco laboris nisi ut aliquip ex ea commodo consequat. Duis aute irure dolor in reprehenderit in voluptate velit esse cillum dolore eu fugiat nulla pariatur. Excepteur sint occaecat cupidatat non proident, sunt in culpa qui officia deserunt mollit anim id est laborum."
+
+function workload_rw() {
+    touch "$MNTPOINT"/file0
+    echo "$GOLDEN" | tee "$MNTPOINT"/file0 >/dev/null
+    cat "$MNTPOINT"/file0 >/dev/null
+}
+
+function workload_cp() {
+    touch "$MNTPOINT"/file9
+    echo "$GOLDEN" | tee "$MNTPOINT"/file9 >/dev/null
+    cat "$MNTPOINT"/file9 >/dev/null
+    cp "$MNTPOINT"/file9 "$MNTPOINT"/file10
+    cat "$MNTPOINT"/file10 >/dev/null
+}
+
+function report() {
+    NAME=$1
+    printf "%-6s %-8s %8s %8s %8s %12s\n" "case" "phase" "read" "write" "seek" "seek/op"
+    for PHASE in mount run umount; do
+        R=$(device_stat "$PHASE" read)
+        W=$(device_stat "$PHASE" write)
+        S=$(device_stat "$PHASE" seek)
+        OPS=$((R + W))
+        if (( OPS == 0 )); then
+            RATIO="-"
+        else
+            RATIO=$(awk "BEGIN { printf \"%.3f\", $S / $OPS }")
+        fi
+        printf "%-6s %-8s %8d %8d %8d %12s\n" "$NAME" "$PHASE" "$R" "$W" "$S" "$RATIO"
+    done
+    grep -a "^cache:" "$LOG"
+}
+
+for WORKLOAD in rw cp; do
+    bench_mount "$@"
+    "workload_$WORKLOAD"
+    bench_umount
+    report "$WORKLOAD"
+    echo
+done
@@ -0,0 +1,69 @@
+#!/bin/bash
+# 稀疏文件回归：扩展文件只改大小，读空洞不访问设备，
+# 分散写入只分配写到的块，重挂后内容与本地参照文件一致；
+# fallocate 预分配的区间读为零，顺序写满后仍是一个物理段
+
+# shellcheck source=/dev/null
+source "$(cd "$(dirname "$0")" && pwd)"/common.sh
+
+REF="$BENCH_PATH"/sparse.ref
+OFFSETS=(0 5000 1048575 20000000 67108000)
+
+# 参数: 目标文件，在各偏移处写入一小段
+function scatter_write() {
+    truncate -s 64M "$1"
+    for ofs in "${OFFSETS[@]}"; do
+        printf 'juzfs@%d' "$ofs" | dd of="$1" bs=1 seek="$ofs" conv=notrunc status=none
+    done
+}
+
+TEST_CASE="sparse 1 - 64MiB空洞文件, 读取不访问设备"
+bench_mount --cache_size=0
+truncate -s 64M "$MNTPOINT"/file0
+FREE0=$(stat -f -c %f "$MNTPOINT")
+cat "$MNTPOINT"/file0 > /dev/null
+FREE1=$(stat -f -c %f "$MNTPOINT")
+bench_umount
+READS=$(device_stat run read)
+if [[ "$READS" == "0" && "$FREE0" == "$FREE1" ]]; then
+    pass "$TEST_CASE (read=$READS)"
+else
+    fail "$TEST_CASE: 期望 read=0 且空闲块不变, 实际 read=$READS free=$FREE0->$FREE1"
+fi
+
+TEST_CASE="sparse 2 - 分散写入后重挂, 内容一致"
+scatter_write "$REF"
+bench_mount
+FREE0=$(stat -f -c %f "$MNTPOINT")
+scatter_write "$MNTPOINT"/file1
+FREE1=$(stat -f -c %f "$MNTPOINT")
+bench_umount
+JFS_IMAGE_KEEP=1 bench_mount
+if cmp -s "$REF" "$MNTPOINT"/file1 && (( FREE0 - FREE1 <= ${#OFFSETS[@]} * 2 )); then
+    pass "$TEST_CASE (used=$((FREE0 - FREE1)) blks)"
+else
+    fail "$TEST_CASE: 内容不一致或占用块数过多 (used=$((FREE0 - FREE1)))"
+fi
+bench_umount
+
+TEST_CASE="sparse 3 - fallocate 预分配后顺序写入"
+bench_mount --cache_size=0
+fallocate -l 1M "$MNTPOINT"/file2
+fallocate -n -l 1M "$MNTPOINT"/file3
+SIZE3=$(stat -c %s "$MNTPOINT"/file3)
+cat "$MNTPOINT"/file2 > /dev/null
+dd if=/dev/urandom of="$REF" bs=64K count=16 status=none
+dd if="$REF" of="$MNTPOINT"/file2 bs=64K conv=notrunc status=none
+bench_umount
+READS=$(device_stat run read)
+FRAG=$(grep -a "^frag:" "$LOG" | tail -1)
+JFS_IMAGE_KEEP=1 bench_mount
+if [[ "$READS" == "0" && "$SIZE3" == "0" ]] && cmp -s "$REF" "$MNTPOINT"/file2; then
+    pass "$TEST_CASE ($FRAG)"
+else
+    fail "$TEST_CASE: read=$READS file3大小=$SIZE3, 或内容不一致"
+fi
+bench_umount
+
+rm -f "$REF"
+exit $FAILED